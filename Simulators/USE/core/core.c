@@ -1026,6 +1026,10 @@ void thread_loop(unsigned int thread_id) {
 			if(++empty_fetch > 500){
 				round_check_OnGVT();
 			}
+#endif
+#if REVERSIBLE_IO==1 && IO_COMMITTER_THREAD==0 && IO_COMMIT_STEALING==1
+			//nothing to process, we use the cycle to execute some committed I/O
+			reversibleio_try_execute(IO_COMMIT_QUANTUM);
 #endif
 			goto end_loop;
 		}
@@ -1182,12 +1186,13 @@ void thread_loop(unsigned int thread_id) {
 		}
 #endif
 
+#if REVERSIBLE_IO==1
+		//the output of the events committed so far can be executed
+		if(safe){
+			reversibleio_collect(current_lp);
+		}
+#endif
 		if(safe && (++(LPS[current_lp]->until_clean_ckp)%CLEAN_CKP_INTERVAL  == 0) ){
-				#if REVERSIBLE_IO==1
-					if(tid== MAIN_PROCESS){
-						reversibleio_execute();
-					}
-				#endif
 				clean_checkpoint(current_lp, LPS[current_lp]->commit_horizon_ts);
 		}
 
@@ -1207,6 +1212,12 @@ void thread_loop(unsigned int thread_id) {
 			#endif
 			commit_event(current_msg, current_node, current_lp);
 		}
+#if REVERSIBLE_IO==1 && IO_COMMITTER_THREAD==0
+		//the collected operations are executed when enough bytes are waiting or when their deadline expires
+		if(safe && reversibleio_commit_due()){
+			reversibleio_execute();
+		}
+#endif
 
 end_loop:
 		//CHECK END SIMULATION
@@ -1373,6 +1384,10 @@ void thread_loop(unsigned int thread_id) {
 			if(++empty_fetch > 500){
 				round_check_OnGVT();
 			}
+#endif
+#if REVERSIBLE_IO==1 && IO_COMMITTER_THREAD==0 && IO_COMMIT_STEALING==1
+			//nothing to process, we use the cycle to execute some committed I/O
+			reversibleio_try_execute(IO_COMMIT_QUANTUM);
 #endif
 			goto end_loop;
 		}
@@ -1618,12 +1633,13 @@ void thread_loop(unsigned int thread_id) {
 		}
 #endif
 
+#if REVERSIBLE_IO==1
+		//the output of the events committed so far can be executed
+		if(safe){
+			reversibleio_collect(current_lp);
+		}
+#endif
 		if(safe && (++(LPS[current_lp]->until_clean_ckp)%CLEAN_CKP_INTERVAL  == 0) ){
-			#if REVERSIBLE_IO==1
-			if(tid== MAIN_PROCESS){
-				reversibleio_execute();
-			}
-			#endif
 				clean_checkpoint(current_lp, LPS[current_lp]->commit_horizon_ts);
 		}
 
@@ -1643,6 +1659,12 @@ void thread_loop(unsigned int thread_id) {
 		if(safe) {
 			commit_event(current_msg, current_node, current_lp);
 		}
+#if REVERSIBLE_IO==1 && IO_COMMITTER_THREAD==0
+		//the collected operations are executed when enough bytes are waiting or when their deadline expires
+		if(safe && reversibleio_commit_due()){
+			reversibleio_execute();
+		}
+#endif
 
 #if REPORT == 1
 		//statistics_post_th_data(tid, STAT_CLOCK_PRUNE, clock_timer_value(queue_op));
@@ -1667,12 +1689,6 @@ end_loop:
 			if(check_termination()){
 				__sync_bool_compare_and_swap(&stop, false, true);
 			}
-#if REVERSIBLE_IO==1
-			if(tid == MAIN_PROCESS){
-				reversibleio_flush();
-				reversibleio_destroy();
-			}
-#endif
 		}
 
 
@@ -1701,6 +1717,10 @@ end_loop:
 		//sleep(5);
 		printf(GREEN( "[%u] Execution ended correctly\n"), tid);
 		if(tid==0){
+			#if REVERSIBLE_IO==1
+			reversibleio_flush();
+			reversibleio_destroy();
+			#endif
 			pthread_join(sleeper, NULL);
 
 		}
@@ -190,7 +190,14 @@ bool commit_event(msg_t * event, nbc_bucket_node * node, unsigned int lp_idx){
 
 
 
+#if REVERSIBLE_IO==1
+#define collect_committed_io(lp_idx)	reversibleio_collect(lp_idx)
+#else
+#define collect_committed_io(lp_idx)
+#endif
+
 #define do_commit_inside_lock_and_goto_next(event,node,lp_idx)			{	commit_event(event,node,lp_idx);\
+																			collect_committed_io(lp_idx);\
 																			unlock(lp_idx);\
 																			goto get_next;	}
 		
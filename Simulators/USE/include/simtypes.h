@@ -149,6 +149,16 @@ typedef struct _LP_state {
 
 #if REVERSIBLE_IO==1
 	nblist io_forward_window,io_reverse_window;
+	/// Last message whose I/O operations have been collected, the next collection restarts from here
+	msg_t*	io_collect_cursor;
+	/// Epoch of io_collect_cursor when it was collected, used to detect if the message has been reused
+	unsigned int io_collect_epoch;
+	/// Frame of io_collect_cursor when it was collected, used to detect if the message has been reused
+	unsigned int io_collect_frame;
+	/// Journals of the virtual positions of the LP on the positioned streams
+	struct _iopos* io_positions;
+	/// Journal of the updates of the reversible metrics made by the events of the LP which have not been committed yet
+	struct _iometrics* io_metrics;
 #endif
 
 } LP_state;
@@ -286,6 +286,10 @@ unsigned int silent_execution(unsigned int lid, void *state_buffer, msg_t *evt,
 		start_exposition_of_current_event(evt);
 		#endif
 
+		#if REVERSIBLE_IO==1
+		reversibleio_replay(evt);
+		#endif
+
 		executeEvent(lid, evt->timestamp, evt->type, evt->data, evt->data_size, state_buffer, true, evt);
 
 		#if HANDLE_INTERRUPT==1
@@ -330,6 +334,10 @@ unsigned int silent_execution(unsigned int lid, void *state_buffer, msg_t *evt,
 	#if HANDLE_INTERRUPT==1
 	LPS[lid]->last_silent_exec_evt = last_executed_event;
 	#endif
+
+	#if REVERSIBLE_IO==1
+	reversibleio_replay(NULL);
+	#endif
 	
 	LPS[lid]->state = old_state;
 
@@ -417,6 +425,10 @@ unsigned int silent_execution(unsigned int lid, void *state_buffer, msg_t *evt,
 		check_events_state(old_state,evt,local_next_evt);
 		#endif
 
+		#if REVERSIBLE_IO==1
+		reversibleio_replay(evt);
+		#endif
+
 		executeEvent(lid, evt->timestamp, evt->type, evt->data, evt->data_size, state_buffer, true, evt);
 		#if HANDLE_INTERRUPT==1
 		change_dest_ts(lid,&until_ts,&tie_breaker);//if ScheduleNeWEvent viewed priority_message it changed the bound with priority_msg but doesn't chagne dest_ts 
@@ -468,6 +480,10 @@ unsigned int silent_execution(unsigned int lid, void *state_buffer, msg_t *evt,
 	#if HANDLE_INTERRUPT==1
 	LPS[lid]->last_silent_exec_evt = last_executed_event;
 	#endif
+
+	#if REVERSIBLE_IO==1
+	reversibleio_replay(NULL);
+	#endif
 	
 	LPS[lid]->state = old_state;
 	return events;
@@ -527,6 +543,13 @@ void rollback(unsigned int lid, simtime_t destination_time, unsigned int tie_bre
 
 	clock_timer_start(rollback_timer);
 
+	#if REVERSIBLE_IO==1
+	//the writes executed immediately by the events which will be executed again must be undone
+	if(LPS[lid]->state == LP_STATE_ROLLBACK){
+		reversibleio_undo(lid,destination_time,tie_breaker);
+	}
+	#endif
+
 	// Find the state to be restored, and prune the wrongly computed states
 	restore_state = list_tail(LPS[lid]->queue_states);
 	
@@ -813,7 +836,7 @@ void clean_checkpoint(unsigned int lid, simtime_t commit_horizon) {
 		//	to_msg = to_state->last_event;
 	}
 	#if REVERSIBLE_IO==1
-	reversibleio_collect(current_lp,LPS[current_lp]->commit_horizon_ts,to_msg);
+	reversibleio_detach(lid,to_msg);
 	#endif
 
 	//Rimozione Stati
@@ -144,26 +144,29 @@ static void io_heapify(io_heap * h, int i) {
 	}
 }
 
-nblist_elem* io_heap_poll(io_heap * h) {
-
-	double newkey = -1;
-	void* content;
-	content=NULL;
-
-	if(h->used > 0) {
-		io_heap_entry *e = &h->array[0];
-		//h->array[0] = h->array[h->used - 1];
-		//h->used -= 1;
-		//io_heapify(h, 0);
-		//rsfree(e);
-		content = nblist_pop(e->payload);
-		if(content!=NULL){
-			newkey=nblist_peek(e->payload)->key;
-			io_heap_update_key(h,e,newkey);
+void* io_heap_poll(io_heap * h, double horizon) {
+
+	io_heap_entry *e;
+	nblist_elem *next;
+	double key;
+
+	while(h->used > 0) {
+		e = &h->array[0];
+		//the keys are refreshed lazily, since the producers cannot touch the heap
+		next = nblist_peek(e->payload);
+		//an empty window will not receive anything older than the horizon
+		key = next != NULL ? next->key : horizon;
+		if(key != e->key) {
+			io_heap_update_key(h, e, key);
+			continue;
 		}
+		if(key >= horizon)
+			return NULL;
+		//the key of the entry will be refreshed by the next poll
+		return nblist_pop(e->payload);
 	}
 
-	return content;
+	return NULL;
 }
 
 void io_heap_delete(io_heap * hh) {
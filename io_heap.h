@@ -27,7 +27,12 @@ typedef struct {
 io_heap * io_heap_new(HEAP_TYPE type, int capacity);
 HEAP_TYPE io_heap_type(io_heap * h);
 double io_heap_peek(io_heap * h);
-nblist_elem* io_heap_poll(io_heap* h);
+/** \brief Extracts the oldest operation among all the lists in the heap.
+ * \param[in] h The heap.
+ * \param[in] horizon Nothing older than the horizon can still be added to the lists, so only the operations before it are extracted.
+ * \returns The content of the oldest element if its key is before the horizon, NULL otherwise.
+ */
+void* io_heap_poll(io_heap* h, double horizon);
 io_heap_entry * io_heap_add(io_heap * h, nblist* payload);
 double get_key_entry(io_heap_entry* ee);
 int io_heap_size(io_heap * h);
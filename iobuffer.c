@@ -5,14 +5,15 @@
 #include<stdlib.h>
 #include<string.h>
 #include<stdio.h>
+#include<unistd.h>
 
 #include "iobuffer.h"
 #include "dymelor.h"
 #include "wrappers.h"
 
-iobuffer* create_iobuffer(FILE* file, void* content, size_t element_size,size_t element_num, double timestamp, int file_position, iobuf_operation_request operation){
+iobuffer* create_iobuffer(FILE* file, void* content, size_t element_size,size_t element_num, double timestamp, long file_position, iobuf_operation_request operation){
 	//sanity checks
-	if(file==NULL || timestamp<0 || (content==NULL && (element_num!=0 || element_size!=0)) || (content==NULL && (element_num==0 || element_size==0))){
+	if((file==NULL && operation!=IOBUF_MMAP) || timestamp<0 || (content==NULL && element_num!=0 && element_size!=0)){
 		return NULL;
 	}
 	iobuffer* buf=rsalloc(sizeof(iobuffer));
@@ -51,7 +52,7 @@ int iobuffer_write(iobuffer *iobuf){
 	int res=0;
 	if(iobuf->buffer_elements_num>0 && iobuf->buffer_elements_size>0 && iobuf->operation==IOBUF_FWRITE){
 		if(iobuf->file_position>=0){
-			fseek(iobuf->file,iobuf->file_position,SEEK_SET);
+			__real_fseek(iobuf->file,iobuf->file_position,SEEK_SET);
 		}
 		res=__real_fwrite(iobuf->buffer,iobuf->buffer_elements_size,iobuf->buffer_elements_num,iobuf->file);
 		if(res<0){
@@ -68,3 +69,29 @@ int iobuffer_write(iobuffer *iobuf){
 	}
 	return IOBUF_OP_SUCCESS;
 }
+
+int iobuffer_undo(iobuffer *iobuf){
+	int fd;
+	ssize_t res;
+	size_t done=0,len;
+	if(iobuf==NULL){
+		return ENOENT;
+	}
+	//the bytes of the undone write could still be in the FILE buffer
+	fflush(iobuf->file);
+	fd=fileno(iobuf->file);
+	len=iobuf->buffer_elements_num*iobuf->buffer_elements_size;
+	while(done<len){
+		res=pwrite(fd,(char*)iobuf->buffer+done,len-done,iobuf->file_position+done);
+		if(res<=0){
+			return EIO;
+		}
+		done+=res;
+	}
+	//the newer writes have already been undone, so the file cannot be shorter than before this one
+	if(ftruncate(fd,iobuf->file_end)!=0){
+		return EIO;
+	}
+	__real_fseek(iobuf->file,iobuf->file_position,SEEK_SET);
+	return IOBUF_OP_SUCCESS;
+}
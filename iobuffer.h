@@ -12,9 +12,13 @@
 ///This enum is used to check if the model has requested an fclose.
 typedef enum _iobuf_operation_request{
 	IOBUF_FWRITE=0, ///< fwrite has been issued.
-	IOBUF_FCLOSE ///< fclose has been issued.
+	IOBUF_FCLOSE, ///< fclose has been issued.
+	IOBUF_MMAP, ///< A page of a mapped file has been saved, see iomap.h.
+	IOBUF_FOPEN ///< A pooled file has been opened, the undo record drops the reference (see iopool.h).
 } iobuf_operation_request;
 
+struct _iomap;
+
 ///An iobuffer, will hold the buffer of chars to be written and the file pointer which specified where these chars must be written. Additionally it will hold the request to close the file.
 typedef struct _iobuffer{
 	FILE* file; ///< The file where the chars need to be printed.
@@ -24,6 +28,8 @@ typedef struct _iobuffer{
 	void* buffer; ///< The buffer where the chars will be stored until they are printed.
 	size_t buffer_elements_num; ///< The number of elements in the buffer
 	size_t buffer_elements_size; ///< The size of a single element in the buffer
+	long file_end; ///< For an undo record, the size of the file before the operation.
+	struct _iomap* map; ///< For an ::IOBUF_MMAP undo record, the mapped file.
 } iobuffer;
 
 /** \brief Creates a new iobuffer.
@@ -34,7 +40,7 @@ typedef struct _iobuffer{
  * \param[in] file_position The position inside the file.
  * \returns the iobuffer on success, otherwise NULL.
 */
-iobuffer* create_iobuffer(FILE* file, void* content, size_t element_size, size_t element_num, double timestamp, int file_position, iobuf_operation_request operation);
+iobuffer* create_iobuffer(FILE* file, void* content, size_t element_size, size_t element_num, double timestamp, long file_position, iobuf_operation_request operation);
 
 /** \brief Deallocates a iobuffer list element, destroying the list in the process.
  * \param[in] elem The list element to be destroyed.
@@ -47,4 +53,12 @@ void destroy_iobuffer(void* iobuf);
  */
 int iobuffer_write(iobuffer *iobuf);
 
+/** \brief Undoes a write which has been executed immediately, using its undo record.
+ * The buffer holds the overwritten bytes, which are written back at the file position, then the file is truncated to its previous size and the file position is restored.
+ * The undo records of a file must be applied from the newest to the oldest.
+ * \param[in] iobuf The undo record.
+ * \return ::IOBUF_OP_SUCCESS or an error code
+ */
+int iobuffer_undo(iobuffer *iobuf);
+
 #endif // PRINTBUFFER_H_INCLUDED
@@ -0,0 +1,289 @@
+/** \file iocolumnar.c
+ * Implementation of the columnar output.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iocolumnar.h"
+#include "dymelor.h"
+
+///Maximum number of distinct values of a dictionary.
+#define DICT_MAX 256
+///Maximum size of a varint.
+#define VARINT_MAX 10
+
+struct _iocolumnar{
+	size_t record_size; ///< The size of the records.
+	unsigned int n; ///< The number of columns.
+	iocolumn* columns; ///< The columns.
+	char* rows; ///< The current batch, as it has been written by the model.
+	size_t rows_len; ///< The bytes in the current batch.
+	char* out; ///< The encoded column.
+	size_t out_size; ///< The size of out, enough for any encoding of a column.
+	uint64_t offset; ///< The bytes emitted in the current section.
+	uint64_t* batches; ///< The offsets of the batches of the current section.
+	unsigned int batches_len; ///< The number of batches of the current section.
+	unsigned int batches_size; ///< The capacity of batches.
+};
+
+/// \brief returns the value of a field of 1, 2, 4 or 8 bytes.
+static uint64_t field_get(const char* field,size_t size){
+	uint8_t v8;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+	switch(size){
+		case 1:
+			memcpy(&v8,field,1);
+			return v8;
+		case 2:
+			memcpy(&v16,field,2);
+			return v16;
+		case 4:
+			memcpy(&v32,field,4);
+			return v32;
+		default:
+			memcpy(&v64,field,8);
+			return v64;
+	}
+}
+
+/// \brief writes a varint in out, returns its size.
+static size_t varint_put(char* out,uint64_t value){
+	size_t len=0;
+	while(value>=0x80){
+		out[len++]=(char)((value&0x7F)|0x80);
+		value>>=7;
+	}
+	out[len++]=(char)value;
+	return len;
+}
+
+/// \brief encodes a column as the zigzag varints of the differences between the values.
+static size_t encode_delta(iocolumnar* columnar,iocolumn* column,unsigned int rows){
+	unsigned int i;
+	uint64_t value,prev=0;
+	int64_t delta;
+	size_t len=0;
+	for(i=0;i<rows;i++){
+		value=field_get(columnar->rows+i*columnar->record_size+column->offset,column->size);
+		delta=(int64_t)(value-prev);
+		if(column->size<8){
+			//the difference of a narrow field wraps around within its width
+			delta=(int64_t)((value-prev)<<(64-8*column->size))>>(64-8*column->size);
+		}
+		len+=varint_put(columnar->out+len,((uint64_t)delta<<1)^(uint64_t)(delta>>63));
+		prev=value;
+	}
+	return len;
+}
+
+/// \brief encodes a column with a dictionary, returns 0 if the column has too many distinct values.
+static size_t encode_dict(iocolumnar* columnar,iocolumn* column,unsigned int rows){
+	uint64_t dict[DICT_MAX],value;
+	unsigned int i,j,dict_len=0;
+	size_t len;
+	//the indexes are written after the dictionary, which is not known until the end
+	char* indexes=columnar->out+VARINT_MAX+DICT_MAX*column->size;
+	for(i=0;i<rows;i++){
+		value=field_get(columnar->rows+i*columnar->record_size+column->offset,column->size);
+		for(j=0;j<dict_len && dict[j]!=value;j++);
+		if(j==dict_len){
+			if(dict_len==DICT_MAX){
+				return 0;
+			}
+			dict[dict_len++]=value;
+		}
+		indexes[i]=(char)j;
+	}
+	len=varint_put(columnar->out,dict_len);
+	for(j=0;j<dict_len;j++){
+		//the values are written back with their own size
+		for(i=0;i<column->size;i++){
+			columnar->out[len++]=(char)(dict[j]>>(8*i));
+		}
+	}
+	memmove(columnar->out+len,indexes,rows);
+	return len+rows;
+}
+
+/// \brief copies a column.
+static size_t encode_plain(iocolumnar* columnar,iocolumn* column,unsigned int rows){
+	unsigned int i;
+	for(i=0;i<rows;i++){
+		memcpy(columnar->out+i*column->size,columnar->rows+i*columnar->record_size+column->offset,column->size);
+	}
+	return rows*column->size;
+}
+
+/// \brief returns 1 if the field can be read as an integer.
+static int field_is_integer(size_t size){
+	return size==1 || size==2 || size==4 || size==8;
+}
+
+/// \brief encodes and emits the whole records of the current batch.
+static int batch_emit(iocolumnar* columnar,iocolumnar_emit emit,void* arg){
+	unsigned int i,rows=columnar->rows_len/columnar->record_size;
+	uint64_t* batches;
+	uint32_t header;
+	uint8_t encoding;
+	size_t len;
+	int res;
+	if(rows==0){
+		return 0;
+	}
+	if(columnar->batches_len==columnar->batches_size){
+		batches=rsrealloc(columnar->batches,sizeof(uint64_t)*(columnar->batches_size*2+8));
+		if(batches==NULL){
+			return ENOMEM;
+		}
+		columnar->batches=batches;
+		columnar->batches_size=columnar->batches_size*2+8;
+	}
+	columnar->batches[columnar->batches_len++]=columnar->offset;
+	header=rows;
+	res=emit(arg,(char*)&header,sizeof(uint32_t));
+	columnar->offset+=sizeof(uint32_t);
+	for(i=0;i<columnar->n && res==0;i++){
+		encoding=columnar->columns[i].encoding;
+		len=0;
+		if(!field_is_integer(columnar->columns[i].size)){
+			encoding=IOCOLUMN_PLAIN;
+		}
+		if(encoding==IOCOLUMN_DICT){
+			len=encode_dict(columnar,&columnar->columns[i],rows);
+			if(len==0){
+				encoding=IOCOLUMN_PLAIN;
+			}
+		}else if(encoding==IOCOLUMN_DELTA){
+			len=encode_delta(columnar,&columnar->columns[i],rows);
+		}
+		if(encoding==IOCOLUMN_PLAIN){
+			len=encode_plain(columnar,&columnar->columns[i],rows);
+		}
+		header=len;
+		res=emit(arg,(char*)&encoding,sizeof(uint8_t));
+		if(res==0){
+			res=emit(arg,(char*)&header,sizeof(uint32_t));
+		}
+		if(res==0){
+			res=emit(arg,columnar->out,len);
+		}
+		columnar->offset+=sizeof(uint8_t)+sizeof(uint32_t)+len;
+	}
+	//an incomplete record is kept for the next batch
+	len=rows*columnar->record_size;
+	memmove(columnar->rows,columnar->rows+len,columnar->rows_len-len);
+	columnar->rows_len-=len;
+	return res;
+}
+
+iocolumnar* iocolumnar_new(size_t record_size,const iocolumn* columns,unsigned int n){
+	unsigned int i;
+	size_t widest=VARINT_MAX;
+	iocolumnar* columnar;
+	if(record_size==0 || n==0 || columns==NULL){
+		return NULL;
+	}
+	for(i=0;i<n;i++){
+		if(columns[i].size==0 || columns[i].offset+columns[i].size>record_size){
+			return NULL;
+		}
+		if(columns[i].size>widest){
+			widest=columns[i].size;
+		}
+	}
+	columnar=rsalloc(sizeof(iocolumnar));
+	if(columnar==NULL){
+		return NULL;
+	}
+	memset(columnar,0,sizeof(iocolumnar));
+	columnar->record_size=record_size;
+	columnar->n=n;
+	columnar->columns=rsalloc(sizeof(iocolumn)*n);
+	columnar->rows=rsalloc(record_size*IO_COLUMNAR_ROWS);
+	//the dictionary encoding needs room for the indexes after the largest dictionary
+	columnar->out_size=widest*IO_COLUMNAR_ROWS+VARINT_MAX+DICT_MAX*sizeof(uint64_t);
+	columnar->out=rsalloc(columnar->out_size);
+	if(columnar->columns==NULL || columnar->rows==NULL || columnar->out==NULL){
+		iocolumnar_delete(columnar);
+		return NULL;
+	}
+	memcpy(columnar->columns,columns,sizeof(iocolumn)*n);
+	return columnar;
+}
+
+int iocolumnar_add(iocolumnar* columnar,const char* data,size_t len,iocolumnar_emit emit,void* arg){
+	size_t chunk,batch=columnar->record_size*IO_COLUMNAR_ROWS;
+	int res;
+	while(len>0){
+		chunk=batch-columnar->rows_len;
+		if(chunk>len){
+			chunk=len;
+		}
+		memcpy(columnar->rows+columnar->rows_len,data,chunk);
+		columnar->rows_len+=chunk;
+		data+=chunk;
+		len-=chunk;
+		if(columnar->rows_len==batch){
+			res=batch_emit(columnar,emit,arg);
+			if(res!=0){
+				return res;
+			}
+		}
+	}
+	return 0;
+}
+
+int iocolumnar_finish(iocolumnar* columnar,iocolumnar_emit emit,void* arg){
+	unsigned int i;
+	uint32_t value,footer_len;
+	uint8_t encoding;
+	int res;
+	size_t dropped;
+	res=batch_emit(columnar,emit,arg);
+	//what is left is an incomplete record, the section is completed without it but the loss is reported
+	dropped=columnar->rows_len;
+	columnar->rows_len=0;
+	if(res!=0 || columnar->batches_len==0){
+		return res!=0 ? res : (dropped>0 ? EINVAL : 0);
+	}
+	value=columnar->record_size;
+	res|=emit(arg,(char*)&value,sizeof(uint32_t));
+	value=columnar->n;
+	res|=emit(arg,(char*)&value,sizeof(uint32_t));
+	for(i=0;i<columnar->n;i++){
+		value=columnar->columns[i].offset;
+		res|=emit(arg,(char*)&value,sizeof(uint32_t));
+		value=columnar->columns[i].size;
+		res|=emit(arg,(char*)&value,sizeof(uint32_t));
+		encoding=columnar->columns[i].encoding;
+		res|=emit(arg,(char*)&encoding,sizeof(uint8_t));
+	}
+	value=columnar->batches_len;
+	res|=emit(arg,(char*)&value,sizeof(uint32_t));
+	res|=emit(arg,(char*)columnar->batches,sizeof(uint64_t)*columnar->batches_len);
+	footer_len=3*sizeof(uint32_t)+columnar->n*(2*sizeof(uint32_t)+sizeof(uint8_t))+sizeof(uint64_t)*columnar->batches_len;
+	res|=emit(arg,(char*)&footer_len,sizeof(uint32_t));
+	res|=emit(arg,"RIOC",4);
+	columnar->offset=0;
+	columnar->batches_len=0;
+	if(res!=0){
+		return EIO;
+	}
+	return dropped>0 ? EINVAL : 0;
+}
+
+void iocolumnar_delete(iocolumnar* columnar){
+	if(columnar==NULL){
+		return;
+	}
+	rsfree(columnar->columns);
+	rsfree(columnar->rows);
+	rsfree(columnar->out);
+	rsfree(columnar->batches);
+	rsfree(columnar);
+}
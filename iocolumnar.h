@@ -0,0 +1,73 @@
+/** \file iocolumnar.h
+ * Columnar output for the streams of fixed size records: the records are gathered in batches and each batch is written transposed, one encoded block per column.
+ *
+ * A batch is written as: uint32 rows, then for each column uint8 encoding, uint32 length and the encoded column.
+ * When the stream is closed (or a segment ends) a footer follows the batches: uint32 record size, uint32 columns, for each column uint32 offset, uint32 size and uint8 requested encoding,
+ * uint32 batches, uint64 offset of each batch from the start of the section, uint32 length of the footer up to here and the magic "RIOC".
+ * All the integers are in the byte order of the host.
+ */
+
+#ifndef IOCOLUMNAR_H_INCLUDED
+#define IOCOLUMNAR_H_INCLUDED
+
+#include <stddef.h>
+
+#ifndef IO_COLUMNAR_ROWS
+///Number of records in each batch.
+#define IO_COLUMNAR_ROWS 4096
+#endif
+
+///How a column is encoded.
+typedef enum _iocolumn_encoding{
+	IOCOLUMN_PLAIN=0, ///< The values are copied.
+	IOCOLUMN_DELTA, ///< Each value is written as the zigzag varint of its difference from the previous one, for integers or non negative doubles (e.g. timestamps) of 1, 2, 4 or 8 bytes.
+	IOCOLUMN_DICT ///< The distinct values are written once and each value is written as a one byte index, for columns with at most 256 distinct values in a batch.
+} iocolumn_encoding;
+
+///A column of the records.
+typedef struct _iocolumn{
+	size_t offset; ///< The offset of the field in the record.
+	size_t size; ///< The size of the field.
+	iocolumn_encoding encoding; ///< The encoding of the column, a batch where it cannot be used is written with ::IOCOLUMN_PLAIN.
+} iocolumn;
+
+///The columnar state of a stream.
+typedef struct _iocolumnar iocolumnar;
+
+///The function which receives the encoded data, it returns 0 on success or an error code.
+typedef int (*iocolumnar_emit)(void* arg,char* data,size_t len);
+
+/** \brief Creates the columnar state of a stream.
+ * \param[in] record_size The size of the records.
+ * \param[in] columns The columns, they are copied.
+ * \param[in] n The number of columns.
+ * \returns The columnar state, or NULL if the columns do not fit in the record or on error.
+ */
+iocolumnar* iocolumnar_new(size_t record_size,const iocolumn* columns,unsigned int n);
+
+/** \brief Adds data to the current batch, the batch is encoded and emitted when it is full.
+ * The data does not need to hold whole records.
+ * \param[in,out] columnar The columnar state.
+ * \param[in] data The data.
+ * \param[in] len The size of the data.
+ * \param[in] emit The function which receives the encoded batches.
+ * \param[in] arg The argument of emit.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iocolumnar_add(iocolumnar* columnar,const char* data,size_t len,iocolumnar_emit emit,void* arg);
+
+/** \brief Emits the current batch and the footer, the next data starts a new section.
+ * The bytes of an incomplete record are dropped, the section is completed anyway.
+ * \param[in,out] columnar The columnar state.
+ * \param[in] emit The function which receives the encoded data.
+ * \param[in] arg The argument of emit.
+ * \returns 0 on success, EINVAL if an incomplete record has been dropped, otherwise an error code.
+ */
+int iocolumnar_finish(iocolumnar* columnar,iocolumnar_emit emit,void* arg);
+
+/** \brief Releases the columnar state, the current batch is lost.
+ * \param[in] columnar The columnar state.
+ */
+void iocolumnar_delete(iocolumnar* columnar);
+
+#endif // IOCOLUMNAR_H_INCLUDED
@@ -0,0 +1,125 @@
+/** \file iocompress.c
+ * Implementation of the compression of the committed output with zlib.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iocompress.h"
+
+#if IO_COMPRESSION==1
+#include <zlib.h>
+
+///With this window size deflate produces a gzip member instead of a zlib stream.
+#define GZIP_WINDOW_BITS (15+16)
+
+struct _iocompress{
+	z_stream zs; ///< The deflate state, reset after each block.
+	char* in; ///< The current uncompressed block.
+	size_t in_len; ///< The bytes in the current block.
+	char* out; ///< The compressed block.
+	size_t out_size; ///< The size of out, enough for a whole block.
+};
+
+iocompress* iocompress_new(int level){
+	iocompress* codec=calloc(1,sizeof(iocompress));
+	if(codec==NULL){
+		return NULL;
+	}
+	if(deflateInit2(&codec->zs,level,Z_DEFLATED,GZIP_WINDOW_BITS,8,Z_DEFAULT_STRATEGY)!=Z_OK){
+		free(codec);
+		return NULL;
+	}
+	//the gzip header and trailer are not included by deflateBound
+	codec->out_size=deflateBound(&codec->zs,IO_COMPRESS_BLOCK)+32;
+	codec->in=malloc(IO_COMPRESS_BLOCK);
+	codec->out=malloc(codec->out_size);
+	if(codec->in==NULL || codec->out==NULL){
+		iocompress_delete(codec);
+		return NULL;
+	}
+	return codec;
+}
+
+int iocompress_finish(iocompress* codec,iocompress_emit emit,void* arg){
+	int res;
+	if(codec->in_len==0){
+		return 0;
+	}
+	codec->zs.next_in=(Bytef*)codec->in;
+	codec->zs.avail_in=codec->in_len;
+	codec->zs.next_out=(Bytef*)codec->out;
+	codec->zs.avail_out=codec->out_size;
+	//out is large enough, so the whole member is produced at once
+	res=deflate(&codec->zs,Z_FINISH);
+	codec->in_len=0;
+	if(res!=Z_STREAM_END){
+		deflateReset(&codec->zs);
+		return EIO;
+	}
+	res=emit(arg,codec->out,codec->out_size-codec->zs.avail_out);
+	deflateReset(&codec->zs);
+	return res;
+}
+
+int iocompress_add(iocompress* codec,const char* data,size_t len,iocompress_emit emit,void* arg){
+	size_t chunk;
+	int res;
+	while(len>0){
+		chunk=IO_COMPRESS_BLOCK-codec->in_len;
+		if(chunk>len){
+			chunk=len;
+		}
+		memcpy(codec->in+codec->in_len,data,chunk);
+		codec->in_len+=chunk;
+		data+=chunk;
+		len-=chunk;
+		if(codec->in_len==IO_COMPRESS_BLOCK){
+			res=iocompress_finish(codec,emit,arg);
+			if(res!=0){
+				return res;
+			}
+		}
+	}
+	return 0;
+}
+
+void iocompress_delete(iocompress* codec){
+	if(codec==NULL){
+		return;
+	}
+	deflateEnd(&codec->zs);
+	free(codec->in);
+	free(codec->out);
+	free(codec);
+}
+
+#else
+
+iocompress* iocompress_new(int level){
+	(void)level;
+	return NULL;
+}
+
+int iocompress_add(iocompress* codec,const char* data,size_t len,iocompress_emit emit,void* arg){
+	(void)codec;
+	(void)data;
+	(void)len;
+	(void)emit;
+	(void)arg;
+	return ENOSYS;
+}
+
+int iocompress_finish(iocompress* codec,iocompress_emit emit,void* arg){
+	(void)codec;
+	(void)emit;
+	(void)arg;
+	return ENOSYS;
+}
+
+void iocompress_delete(iocompress* codec){
+	(void)codec;
+}
+
+#endif
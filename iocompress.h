@@ -0,0 +1,55 @@
+/** \file iocompress.h
+ * Compression of the committed output: the records of a stream are gathered in blocks and each block is emitted as an independent gzip member.
+ */
+
+#ifndef IOCOMPRESS_H_INCLUDED
+#define IOCOMPRESS_H_INCLUDED
+
+#include <stddef.h>
+
+#ifndef IO_COMPRESSION
+///If set to 1 the streams can be compressed with zlib.
+#define IO_COMPRESSION 0
+#endif
+
+#ifndef IO_COMPRESS_BLOCK
+///Size (in bytes) of the uncompressed blocks, each block can be decompressed independently.
+#define IO_COMPRESS_BLOCK (256UL<<10)
+#endif
+
+///The compression state of a stream.
+typedef struct _iocompress iocompress;
+
+///The function which receives the compressed data, it returns 0 on success or an error code.
+typedef int (*iocompress_emit)(void* arg,char* data,size_t len);
+
+/** \brief Creates the compression state of a stream.
+ * \param[in] level The zlib compression level (0-9).
+ * \returns The compression state, or NULL on error.
+ */
+iocompress* iocompress_new(int level);
+
+/** \brief Adds data to the current block, the block is compressed and emitted when it is full.
+ * \param[in,out] codec The compression state.
+ * \param[in] data The data to compress.
+ * \param[in] len The size of the data.
+ * \param[in] emit The function which receives the compressed blocks.
+ * \param[in] arg The argument of emit.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iocompress_add(iocompress* codec,const char* data,size_t len,iocompress_emit emit,void* arg);
+
+/** \brief Compresses and emits the current block, even if it is not full.
+ * \param[in,out] codec The compression state.
+ * \param[in] emit The function which receives the compressed block.
+ * \param[in] arg The argument of emit.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iocompress_finish(iocompress* codec,iocompress_emit emit,void* arg);
+
+/** \brief Releases the compression state, the current block is lost.
+ * \param[in] codec The compression state.
+ */
+void iocompress_delete(iocompress* codec);
+
+#endif // IOCOMPRESS_H_INCLUDED
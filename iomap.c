@@ -0,0 +1,184 @@
+/** \file iomap.c
+ * Implementation of the mapped output files.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "iomap.h"
+#include "non_blocking_list.h"
+#include "core.h"
+#include "dymelor.h"
+#include "events.h"
+
+struct _iomap{
+	int fd; ///< The file.
+	char* base; ///< The address of the mapping.
+	size_t size; ///< The size of the mapping.
+	size_t page; ///< The size of a page.
+	msg_t** saved; ///< For each page, the last event which saved it.
+	unsigned int* saved_frame; ///< For each page, the frame of the event which saved it, since the messages are reused.
+	volatile int lock; ///< Protects the committed range.
+	size_t sync_start; ///< The start of the committed range which has not been written back yet.
+	size_t sync_end; ///< The end of the committed range, equal to sync_start if it is empty.
+	struct _iomap* next; ///< The next mapped file.
+};
+
+///defined in wrappers.c
+extern void init_window(msg_t* msg,nblist* list);
+
+///The mapped files, they are released at the end of the simulation.
+static iomap* maps=NULL;
+static volatile int maps_lock=0;
+
+iomap* iomap_open(const char* path,size_t size){
+	struct stat st;
+	iomap* map;
+	size_t pages;
+	if(path==NULL || size==0){
+		errno=EINVAL;
+		return NULL;
+	}
+	map=rsalloc(sizeof(iomap));
+	if(map==NULL){
+		errno=ENOMEM;
+		return NULL;
+	}
+	memset(map,0,sizeof(iomap));
+	map->fd=open(path,O_RDWR|O_CREAT,0644);
+	if(map->fd<0){
+		rsfree(map);
+		return NULL;
+	}
+	if(fstat(map->fd,&st)!=0 || ((size_t)st.st_size<size && ftruncate(map->fd,size)!=0)){
+		close(map->fd);
+		rsfree(map);
+		return NULL;
+	}
+	map->base=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,map->fd,0);
+	if(map->base==MAP_FAILED){
+		close(map->fd);
+		rsfree(map);
+		return NULL;
+	}
+	map->size=size;
+	map->page=sysconf(_SC_PAGESIZE);
+	pages=(size+map->page-1)/map->page;
+	map->saved=rsalloc(sizeof(msg_t*)*pages);
+	map->saved_frame=rsalloc(sizeof(unsigned int)*pages);
+	if(map->saved==NULL || map->saved_frame==NULL){
+		if(map->saved!=NULL){
+			rsfree(map->saved);
+		}
+		if(map->saved_frame!=NULL){
+			rsfree(map->saved_frame);
+		}
+		munmap(map->base,size);
+		close(map->fd);
+		rsfree(map);
+		errno=ENOMEM;
+		return NULL;
+	}
+	memset(map->saved,0,sizeof(msg_t*)*pages);
+	while(!__sync_bool_compare_and_swap(&maps_lock,0,1));
+	map->next=maps;
+	maps=map;
+	__sync_lock_release(&maps_lock);
+	return map;
+}
+
+void* iomap_at(iomap* map,size_t offset,size_t len){
+	size_t i,first,last,page_len;
+	char* copy;
+	iobuffer* undo;
+	if(map==NULL || offset>map->size || len>map->size-offset){
+		return NULL;
+	}
+	//a silent execution writes again what has not been undone, so nothing has to be saved
+	if(len==0 || LPS[current_lp]->state==LP_STATE_SILENT_EXEC){
+		return map->base+offset;
+	}
+	first=offset/map->page;
+	last=(offset+len-1)/map->page;
+	for(i=first;i<=last;i++){
+		if(map->saved[i]==current_msg && map->saved_frame[i]==current_msg->frame){
+			continue;
+		}
+		page_len=map->size-i*map->page;
+		if(page_len>map->page){
+			page_len=map->page;
+		}
+		copy=rsalloc(page_len);
+		undo=create_iobuffer(NULL,copy,sizeof(char),page_len,current_lvt,i*map->page,IOBUF_MMAP);
+		if(copy==NULL || undo==NULL){
+			rsfree(copy);
+			return NULL;
+		}
+		memcpy(copy,map->base+i*map->page,page_len);
+		undo->map=map;
+		init_window(current_msg,&current_msg->io_reverse_window);
+		if(nblist_add(&current_msg->io_reverse_window,undo,current_lvt,NBLIST_ELEM)!=NBLIST_OP_SUCCESS){
+			destroy_iobuffer(undo);
+			return NULL;
+		}
+		map->saved[i]=current_msg;
+		map->saved_frame[i]=current_msg->frame;
+	}
+	return map->base+offset;
+}
+
+void iomap_undo(iobuffer* undo){
+	iomap* map=undo->map;
+	memcpy(map->base+undo->file_position,undo->buffer,undo->buffer_elements_num*undo->buffer_elements_size);
+	//the event will save the page again when it is executed again
+	map->saved[undo->file_position/map->page]=NULL;
+}
+
+void iomap_commit(iobuffer* undo){
+	iomap* map=undo->map;
+	size_t start=undo->file_position,end=start+undo->buffer_elements_num*undo->buffer_elements_size;
+	while(!__sync_bool_compare_and_swap(&map->lock,0,1));
+	if(map->sync_start==map->sync_end){
+		map->sync_start=start;
+		map->sync_end=end;
+	}else{
+		if(start<map->sync_start){
+			map->sync_start=start;
+		}
+		if(end>map->sync_end){
+			map->sync_end=end;
+		}
+	}
+	//the writeback is only started, the kernel would write the pages anyway
+	if(map->sync_end-map->sync_start>=IO_MMAP_SYNC_BYTES){
+		msync(map->base+map->sync_start,map->sync_end-map->sync_start,MS_ASYNC);
+		map->sync_start=map->sync_end;
+	}
+	__sync_lock_release(&map->lock);
+}
+
+void iomap_sync(){
+	iomap* map;
+	for(map=maps;map!=NULL;map=map->next){
+		msync(map->base,map->size,MS_SYNC);
+		map->sync_start=map->sync_end;
+	}
+}
+
+void iomap_destroy(){
+	iomap* map;
+	while(maps!=NULL){
+		map=maps;
+		maps=map->next;
+		munmap(map->base,map->size);
+		close(map->fd);
+		rsfree(map->saved);
+		rsfree(map->saved_frame);
+		rsfree(map);
+	}
+}
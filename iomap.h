@@ -0,0 +1,56 @@
+/** \file iomap.h
+ * Reversible output files backed by a shared mapping: the model writes them with plain stores and the pages are saved, once per event, before they are modified.
+ */
+
+#ifndef IOMAP_H_INCLUDED
+#define IOMAP_H_INCLUDED
+
+#include <stddef.h>
+
+#include "iobuffer.h"
+
+#ifndef IO_MMAP_SYNC_BYTES
+///Committed bytes of a mapped file after which their pages are scheduled for writeback with msync.
+#define IO_MMAP_SYNC_BYTES (4UL<<20)
+#endif
+
+///A mapped output file.
+typedef struct _iomap iomap;
+
+/** \brief Opens a file and maps it in memory, the file is created or extended to the given size.
+ * A mapped file must be written by a single LP, it is synchronized and unmapped at the end of the simulation.
+ * \param[in] path The path of the file.
+ * \param[in] size The size of the file.
+ * \returns The mapped file, or NULL on error (errno is set).
+ */
+iomap* iomap_open(const char* path,size_t size);
+
+/** \brief Returns the address of a range of a mapped file, so that it can be written by the current event.
+ * The pages of the range are saved before being returned, unless the current event has already saved them, so they can be restored on rollback.
+ * The range must not be written after the end of the event.
+ * \param[in,out] map The mapped file.
+ * \param[in] offset The offset of the range.
+ * \param[in] len The size of the range.
+ * \returns The address of the range, or NULL if it is beyond the end of the file.
+ */
+void* iomap_at(iomap* map,size_t offset,size_t len);
+
+/** \brief Restores a page saved by ::iomap_at, the pages of an event must be restored from the newest to the oldest.
+ * \param[in] undo The undo record of the page.
+ */
+void iomap_undo(iobuffer* undo);
+
+/** \brief Notifies that the event which saved a page has been committed, the page will be written back lazily.
+ * \param[in] undo The undo record of the page.
+ */
+void iomap_commit(iobuffer* undo);
+
+/** \brief Writes back every mapped file and waits for the writes to complete.
+ */
+void iomap_sync();
+
+/** \brief Unmaps and closes every mapped file.
+ */
+void iomap_destroy();
+
+#endif // IOMAP_H_INCLUDED
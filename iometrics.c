@@ -0,0 +1,244 @@
+/** \file iometrics.c
+ * Implementation of the reversible metrics.
+ */
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "iometrics.h"
+#include "wrappers.h"
+#include "core.h"
+#include "dymelor.h"
+#include "events.h"
+
+///Initial capacity of a journal.
+#define IOMETRICS_INITIAL_SIZE 64
+///Maximum length of the name of a metric.
+#define IOMETRICS_NAME_LEN 64
+
+///An update of a metric, made by an event which has not been committed yet.
+typedef struct _iometrics_entry{
+	double timestamp; ///< The timestamp of the event.
+	unsigned int tie_breaker; ///< The tie breaker of the event.
+	int id; ///< The metric.
+	double value; ///< The value added to the metric.
+} iometrics_entry;
+
+///The journal of the updates of an LP, ordered by event.
+typedef struct _iometrics{
+	iometrics_entry* entries; ///< The updates.
+	unsigned int len; ///< The number of updates.
+	unsigned int size; ///< The capacity of entries.
+} iometrics;
+
+///The committed totals of a metric.
+typedef struct _iometrics_metric{
+	char name[IOMETRICS_NAME_LEN]; ///< The name of the metric.
+	double min; ///< The lower bound of the first bucket of a histogram.
+	double width; ///< The width of the buckets of a histogram.
+	unsigned int buckets; ///< The number of buckets, 0 for a counter.
+	unsigned long* counts; ///< The number of values in each bucket.
+	unsigned long count; ///< The number of values.
+	double sum; ///< The sum of the values.
+	double lowest; ///< The minimum value.
+	double highest; ///< The maximum value.
+} iometrics_metric;
+
+static iometrics_metric metrics[IO_MAX_METRICS];
+static volatile int metrics_len=0;
+///Serializes the registrations and the commits, the updates of the events do not need it.
+static volatile int metrics_lock=0;
+static char* summary_path=NULL;
+
+/// \brief registers a metric, or returns the one with the same name.
+static int iometrics_register(const char* name,double min,double max,unsigned int buckets){
+	int i;
+	iometrics_metric* metric;
+	while(!__sync_bool_compare_and_swap(&metrics_lock,0,1));
+	for(i=0;i<metrics_len;i++){
+		if(strncmp(metrics[i].name,name,IOMETRICS_NAME_LEN-1)==0){
+			__sync_lock_release(&metrics_lock);
+			return i;
+		}
+	}
+	if(metrics_len==IO_MAX_METRICS){
+		__sync_lock_release(&metrics_lock);
+		return -1;
+	}
+	metric=&metrics[metrics_len];
+	strncpy(metric->name,name,IOMETRICS_NAME_LEN-1);
+	metric->name[IOMETRICS_NAME_LEN-1]='\0';
+	metric->min=min;
+	metric->buckets=buckets;
+	metric->width=buckets>0 ? (max-min)/buckets : 0;
+	metric->counts=NULL;
+	if(buckets>0){
+		metric->counts=rsalloc(sizeof(unsigned long)*buckets);
+		if(metric->counts==NULL){
+			__sync_lock_release(&metrics_lock);
+			return -1;
+		}
+		memset(metric->counts,0,sizeof(unsigned long)*buckets);
+	}
+	metric->count=0;
+	metric->sum=0;
+	metric->lowest=DBL_MAX;
+	metric->highest=-DBL_MAX;
+	//the metric must be complete before an LP can use its id
+	__sync_synchronize();
+	i=metrics_len++;
+	__sync_lock_release(&metrics_lock);
+	return i;
+}
+
+int iometrics_counter(const char* name){
+	return iometrics_register(name,0,0,0);
+}
+
+int iometrics_histogram(const char* name,double min,double max,unsigned int buckets){
+	if(buckets==0 || !(max>min)){
+		return -1;
+	}
+	return iometrics_register(name,min,max,buckets);
+}
+
+int iometrics_add(int id,double value){
+	iometrics* journal=LPS[current_lp]->io_metrics;
+	iometrics_entry* entry;
+	if(id<0 || id>=metrics_len){
+		return EINVAL;
+	}
+	//the updates of the first execution are still in the journal
+	if(LPS[current_lp]->state==LP_STATE_SILENT_EXEC){
+		return 0;
+	}
+	if(journal==NULL){
+		journal=rsalloc(sizeof(iometrics));
+		if(journal==NULL){
+			return ENOMEM;
+		}
+		journal->entries=rsalloc(sizeof(iometrics_entry)*IOMETRICS_INITIAL_SIZE);
+		if(journal->entries==NULL){
+			rsfree(journal);
+			return ENOMEM;
+		}
+		journal->len=0;
+		journal->size=IOMETRICS_INITIAL_SIZE;
+		LPS[current_lp]->io_metrics=journal;
+	}
+	if(journal->len==journal->size){
+		entry=rsrealloc(journal->entries,sizeof(iometrics_entry)*journal->size*2);
+		if(entry==NULL){
+			return ENOMEM;
+		}
+		journal->entries=entry;
+		journal->size*=2;
+	}
+	//the events are executed in order and the rollbacks cut the tail, so the journal stays ordered
+	entry=&journal->entries[journal->len++];
+	entry->timestamp=current_msg->timestamp;
+	entry->tie_breaker=current_msg->tie_breaker;
+	entry->id=id;
+	entry->value=value;
+	return 0;
+}
+
+void iometrics_summary(const char* path){
+	char* copy=NULL;
+	if(path!=NULL){
+		copy=rsalloc(strlen(path)+1);
+		if(copy==NULL){
+			return;
+		}
+		strcpy(copy,path);
+	}
+	while(!__sync_bool_compare_and_swap(&metrics_lock,0,1));
+	rsfree(summary_path);
+	summary_path=copy;
+	__sync_lock_release(&metrics_lock);
+}
+
+void iometrics_rollback(int lp,double timestamp,unsigned int tie_breaker){
+	iometrics* journal=LPS[lp]->io_metrics;
+	if(journal==NULL){
+		return;
+	}
+	while(journal->len>0 && (journal->entries[journal->len-1].timestamp>timestamp || (journal->entries[journal->len-1].timestamp==timestamp && journal->entries[journal->len-1].tie_breaker>=tie_breaker))){
+		journal->len--;
+	}
+}
+
+void iometrics_commit(int lp,double horizon){
+	unsigned int i,bucket;
+	double offset;
+	iometrics_metric* metric;
+	iometrics* journal=LPS[lp]->io_metrics;
+	if(journal==NULL || journal->len==0 || journal->entries[0].timestamp>=horizon){
+		return;
+	}
+	while(!__sync_bool_compare_and_swap(&metrics_lock,0,1));
+	for(i=0;i<journal->len && journal->entries[i].timestamp<horizon;i++){
+		metric=&metrics[journal->entries[i].id];
+		metric->count++;
+		metric->sum+=journal->entries[i].value;
+		if(journal->entries[i].value<metric->lowest){
+			metric->lowest=journal->entries[i].value;
+		}
+		if(journal->entries[i].value>metric->highest){
+			metric->highest=journal->entries[i].value;
+		}
+		if(metric->buckets>0){
+			offset=(journal->entries[i].value-metric->min)/metric->width;
+			bucket=offset<0 ? 0 : (offset>=metric->buckets ? metric->buckets-1 : (unsigned int)offset);
+			metric->counts[bucket]++;
+		}
+	}
+	__sync_lock_release(&metrics_lock);
+	memmove(&journal->entries[0],&journal->entries[i],sizeof(iometrics_entry)*(journal->len-i));
+	journal->len-=i;
+}
+
+void iometrics_emit(){
+	int i;
+	unsigned int b;
+	int len;
+	char line[256];
+	FILE* file=stderr;
+	iometrics_metric* metric;
+	if(metrics_len==0){
+		return;
+	}
+	if(summary_path!=NULL){
+		file=__real_fopen(summary_path,"w");
+		if(file==NULL){
+			return;
+		}
+	}
+	//the summary is formatted by hand, a printf on the stream could be turned in a wrapped fwrite by the compiler
+	for(i=0;i<metrics_len;i++){
+		metric=&metrics[i];
+		len=snprintf(line,sizeof(line),"%s %s count %lu sum %g min %g max %g\n",metric->name,metric->buckets>0 ? "histogram" : "counter",metric->count,metric->sum,metric->count>0 ? metric->lowest : 0,metric->count>0 ? metric->highest : 0);
+		__real_fwrite(line,sizeof(char),len<(int)sizeof(line) ? len : (int)sizeof(line)-1,file);
+		for(b=0;b<metric->buckets;b++){
+			len=snprintf(line,sizeof(line),"%s bucket %g %g %lu\n",metric->name,metric->min+b*metric->width,metric->min+(b+1)*metric->width,metric->counts[b]);
+			__real_fwrite(line,sizeof(char),len<(int)sizeof(line) ? len : (int)sizeof(line)-1,file);
+		}
+	}
+	if(file!=stderr){
+		__real_fclose(file);
+	}else{
+		fflush(file);
+	}
+}
+
+void iometrics_destroy(int lp){
+	iometrics* journal=LPS[lp]->io_metrics;
+	if(journal==NULL){
+		return;
+	}
+	rsfree(journal->entries);
+	rsfree(journal);
+	LPS[lp]->io_metrics=NULL;
+}
@@ -0,0 +1,66 @@
+/** \file iometrics.h
+ * Reversible counters and histograms, which replace the per event statistics printed by the models.
+ * The updates of each LP are journaled by event, forgotten on rollback and added to the totals only once committed; a summary of the totals is written at the end of the simulation.
+ */
+
+#ifndef IOMETRICS_H_INCLUDED
+#define IOMETRICS_H_INCLUDED
+
+#ifndef IO_MAX_METRICS
+///Maximum number of metrics.
+#define IO_MAX_METRICS 64
+#endif
+
+/** \brief Registers a counter, which keeps the number, the sum, the minimum and the maximum of its values.
+ * Registering again the same name returns the same metric, so it can be done by any event (e.g. the initialization of each LP).
+ * \param[in] name The name of the counter, as it appears in the summary.
+ * \returns The id of the counter, or -1 if there are already ::IO_MAX_METRICS metrics.
+ */
+int iometrics_counter(const char* name);
+
+/** \brief Registers a histogram, a counter which also counts its values in buckets of the same width.
+ * The values out of [min,max) are counted in the first or in the last bucket.
+ * \param[in] name The name of the histogram, as it appears in the summary.
+ * \param[in] min The lower bound of the first bucket.
+ * \param[in] max The upper bound of the last bucket.
+ * \param[in] buckets The number of buckets.
+ * \returns The id of the histogram, or -1 if there are already ::IO_MAX_METRICS metrics, the bounds are not valid or the buckets cannot be allocated.
+ */
+int iometrics_histogram(const char* name,double min,double max,unsigned int buckets);
+
+/** \brief Adds a value to a metric, on behalf of the current event.
+ * \param[in] id The id of the metric.
+ * \param[in] value The value.
+ * \returns 0 on success, EINVAL if the metric does not exist, ENOMEM if the update cannot be journaled.
+ */
+int iometrics_add(int id,double value);
+
+/** \brief Sets the file where the summary is written at the end of the simulation, by default it is written on stderr.
+ * If the path cannot be copied, the previous one is kept.
+ * \param[in] path The path of the file, NULL for stderr.
+ */
+void iometrics_summary(const char* path);
+
+/** \brief Forgets the updates of the events of an LP which are going to be executed again.
+ * \param[in] lp The LP.
+ * \param[in] timestamp The timestamp of the first event which will be executed again.
+ * \param[in] tie_breaker The tie breaker of the first event which will be executed again.
+ */
+void iometrics_rollback(int lp,double timestamp,unsigned int tie_breaker);
+
+/** \brief Adds the updates of an LP older than the horizon to the totals.
+ * \param[in] lp The LP.
+ * \param[in] horizon The commit horizon of the LP.
+ */
+void iometrics_commit(int lp,double horizon);
+
+/** \brief Writes the summary of the totals, to be called once every update has been committed.
+ */
+void iometrics_emit();
+
+/** \brief Releases the journal of an LP.
+ * \param[in] lp The LP.
+ */
+void iometrics_destroy(int lp);
+
+#endif // IOMETRICS_H_INCLUDED
@@ -0,0 +1,128 @@
+/** \file iopool.c
+ * Implementation of the pool of the opened files, a list protected by a spinlock since the files are few and they are opened rarely.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "iopool.h"
+#include "dymelor.h"
+#include "wrappers.h"
+
+///A pooled file.
+typedef struct _iopool_entry{
+	char* path; ///< The path of the file.
+	char* mode; ///< The mode of the file.
+	int lp; ///< The LP which has opened the file.
+	double timestamp; ///< The timestamp of the event which has opened the file.
+	unsigned int tie_breaker; ///< The tie breaker of the event which has opened the file.
+	FILE* file; ///< The FILE.
+	unsigned int refs; ///< The opens which have not been closed or rolled back yet.
+	struct _iopool_entry* next; ///< The next pooled file.
+} iopool_entry;
+
+static iopool_entry* pool=NULL;
+static volatile int pool_lock=0;
+
+/// \brief returns the entry of the given FILE, or NULL if it is not pooled. The caller must hold the lock.
+static iopool_entry* iopool_find(FILE* file){
+	iopool_entry* entry;
+	for(entry=pool;entry!=NULL && entry->file!=file;entry=entry->next);
+	return entry;
+}
+
+FILE* iopool_open(const char* path,const char* mode,int lp,double timestamp,unsigned int tie_breaker,int ref,int* opened){
+	iopool_entry* entry;
+	FILE* file;
+	*opened=0;
+	while(!__sync_bool_compare_and_swap(&pool_lock,0,1));
+	//only the same event executed again gets the same FILE, e.g. a new fopen with "w" must truncate the file
+	for(entry=pool;entry!=NULL;entry=entry->next){
+		if(entry->lp==lp && entry->timestamp==timestamp && entry->tie_breaker==tie_breaker && strcmp(entry->path,path)==0 && strcmp(entry->mode,mode)==0){
+			entry->refs+=ref;
+			file=entry->file;
+			__sync_lock_release(&pool_lock);
+			return file;
+		}
+	}
+	file=__real_fopen(path,mode);
+	if(file!=NULL){
+		entry=rsalloc(sizeof(iopool_entry));
+		if(entry==NULL){
+			__real_fclose(file);
+			__sync_lock_release(&pool_lock);
+			errno=ENOMEM;
+			return NULL;
+		}
+		entry->path=rsalloc(strlen(path)+1);
+		entry->mode=rsalloc(strlen(mode)+1);
+		if(entry->path==NULL || entry->mode==NULL){
+			if(entry->path!=NULL){
+				rsfree(entry->path);
+			}
+			if(entry->mode!=NULL){
+				rsfree(entry->mode);
+			}
+			rsfree(entry);
+			__real_fclose(file);
+			__sync_lock_release(&pool_lock);
+			errno=ENOMEM;
+			return NULL;
+		}
+		strcpy(entry->path,path);
+		strcpy(entry->mode,mode);
+		entry->lp=lp;
+		entry->timestamp=timestamp;
+		entry->tie_breaker=tie_breaker;
+		entry->file=file;
+		entry->refs=ref;
+		entry->next=pool;
+		pool=entry;
+		*opened=1;
+	}
+	__sync_lock_release(&pool_lock);
+	return file;
+}
+
+void iopool_unref(FILE* file){
+	iopool_entry* entry;
+	while(!__sync_bool_compare_and_swap(&pool_lock,0,1));
+	entry=iopool_find(file);
+	if(entry!=NULL && entry->refs>0){
+		entry->refs--;
+	}
+	__sync_lock_release(&pool_lock);
+}
+
+int iopool_release(FILE* file){
+	iopool_entry *entry,**prev;
+	int res=1;
+	while(!__sync_bool_compare_and_swap(&pool_lock,0,1));
+	for(prev=&pool;*prev!=NULL && (*prev)->file!=file;prev=&(*prev)->next);
+	entry=*prev;
+	if(entry!=NULL && entry->refs>1){
+		entry->refs--;
+		res=0;
+	}else if(entry!=NULL){
+		//the FILE is closed by the caller, a new open of the same path will open it again
+		*prev=entry->next;
+		rsfree(entry->path);
+		rsfree(entry->mode);
+		rsfree(entry);
+	}
+	__sync_lock_release(&pool_lock);
+	return res;
+}
+
+void iopool_destroy(){
+	iopool_entry* entry;
+	while(pool!=NULL){
+		entry=pool;
+		pool=entry->next;
+		__real_fclose(entry->file);
+		rsfree(entry->path);
+		rsfree(entry->mode);
+		rsfree(entry);
+	}
+}
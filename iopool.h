@@ -0,0 +1,38 @@
+/** \file iopool.h
+ * A pool of the files opened by the model, keyed by path, mode and opening event: an fopen executed again after a rollback, or by a silent execution, gets the FILE which is already open.
+ * Any other fopen opens the file again, with the usual semantics of its mode.
+ */
+
+#ifndef IOPOOL_H_INCLUDED
+#define IOPOOL_H_INCLUDED
+
+#include <stdio.h>
+
+/** \brief Returns the FILE opened by an earlier execution of the same event with the same path and mode, opening it if needed, and takes a reference on it.
+ * \param[in] path The path.
+ * \param[in] mode The mode.
+ * \param[in] lp The LP which executes the fopen.
+ * \param[in] timestamp The timestamp of the event which executes the fopen.
+ * \param[in] tie_breaker The tie breaker of the event which executes the fopen.
+ * \param[in] ref 1 if a reference must be taken, 0 if the open is being executed again by a silent execution.
+ * \param[out] opened Set to 1 if the file has been opened by this call, 0 if it was already open.
+ * \returns The FILE, or NULL if the file cannot be opened (errno is set).
+ */
+FILE* iopool_open(const char* path,const char* mode,int lp,double timestamp,unsigned int tie_breaker,int ref,int* opened);
+
+/** \brief Drops the reference taken by an fopen which has been rolled back, the file stays open in the pool.
+ * \param[in] file The FILE.
+ */
+void iopool_unref(FILE* file);
+
+/** \brief Drops the reference released by a committed fclose.
+ * \param[in] file The FILE.
+ * \returns 1 if the file must be closed, since it is not pooled or this was its last reference, 0 otherwise.
+ */
+int iopool_release(FILE* file);
+
+/** \brief Closes every pooled file, to be called at the end of the simulation.
+ */
+void iopool_destroy();
+
+#endif // IOPOOL_H_INCLUDED
@@ -0,0 +1,187 @@
+/** \file iopos.c
+ * Implementation of the virtual file positions.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "iopos.h"
+#include "core.h"
+#include "dymelor.h"
+#include "events.h"
+
+///Initial capacity of a journal.
+#define IOPOS_INITIAL_SIZE 8
+
+///The position set by an event.
+typedef struct _iopos_entry{
+	double timestamp; ///< The timestamp of the event.
+	unsigned int tie_breaker; ///< The tie breaker of the event.
+	unsigned long replay; ///< The replay which has set the position, 0 for a normal execution.
+	long position; ///< The position after the event.
+} iopos_entry;
+
+///The journal of the positions of an LP on a stream, ordered by event.
+typedef struct _iopos{
+	FILE* file; ///< The stream.
+	unsigned int serial; ///< The serial of the stream.
+	iopos_entry* entries; ///< The positions.
+	unsigned int len; ///< The number of positions.
+	unsigned int size; ///< The capacity of entries.
+	struct _iopos* next; ///< The journal of the next stream of the LP.
+} iopos;
+
+///The event executed again by the silent execution of the thread, the silent execution does not change current_msg.
+static __thread msg_t* replayed=NULL;
+///Identifies the execution of the replayed event, its entries set by an earlier execution are not seen.
+static __thread unsigned long replay=0;
+///The number of replays, so that each one has its own identifier.
+static volatile unsigned long replays=0;
+
+msg_t* iopos_event(int lp){
+	return replayed!=NULL && LPS[lp]->state==LP_STATE_SILENT_EXEC ? replayed : current_msg;
+}
+
+/// \brief returns the identifier of the execution of the event, 0 for a normal execution.
+static unsigned long executing_replay(int lp){
+	return replayed!=NULL && LPS[lp]->state==LP_STATE_SILENT_EXEC ? replay : 0;
+}
+
+/// \brief returns 1 if the entry has been set by an event after the given one, 0 otherwise.
+static int entry_is_after(iopos_entry* entry,msg_t* event){
+	return entry->timestamp>event->timestamp || (entry->timestamp==event->timestamp && entry->tie_breaker>event->tie_breaker);
+}
+
+/// \brief returns 1 if the entry has been set by the given event, in any of its executions, 0 otherwise.
+static int entry_is_own(iopos_entry* entry,msg_t* event){
+	return entry->timestamp==event->timestamp && entry->tie_breaker==event->tie_breaker;
+}
+
+/** \brief Returns the journal of an LP on a stream.
+ * \param[in] lp The LP.
+ * \param[in] file The stream.
+ * \param[in] serial The serial of the stream, the journal of an older stream with the same FILE is emptied.
+ * \param[in] create 1 if the journal must be created when missing.
+ * \returns The journal, or NULL.
+ */
+static iopos* iopos_find(int lp,FILE* file,unsigned int serial,int create){
+	iopos* pos;
+	for(pos=LPS[lp]->io_positions;pos!=NULL;pos=pos->next){
+		if(pos->file==file){
+			if(pos->serial!=serial){
+				pos->serial=serial;
+				pos->len=0;
+			}
+			return pos;
+		}
+	}
+	if(!create){
+		return NULL;
+	}
+	pos=rsalloc(sizeof(iopos));
+	if(pos==NULL){
+		return NULL;
+	}
+	pos->file=file;
+	pos->serial=serial;
+	pos->entries=rsalloc(sizeof(iopos_entry)*IOPOS_INITIAL_SIZE);
+	if(pos->entries==NULL){
+		rsfree(pos);
+		return NULL;
+	}
+	pos->len=0;
+	pos->size=IOPOS_INITIAL_SIZE;
+	pos->next=LPS[lp]->io_positions;
+	LPS[lp]->io_positions=pos;
+	return pos;
+}
+
+long iopos_get(int lp,FILE* file,unsigned int serial){
+	unsigned int i;
+	msg_t* event=iopos_event(lp);
+	unsigned long execution=executing_replay(lp);
+	iopos* pos=iopos_find(lp,file,serial,0);
+	if(pos==NULL){
+		return 0;
+	}
+	//only a silent execution can see the journal from the past, and it must not see where its event ended the first time
+	for(i=pos->len;i>0;i--){
+		if(entry_is_after(&pos->entries[i-1],event)){
+			continue;
+		}
+		if(!entry_is_own(&pos->entries[i-1],event) || pos->entries[i-1].replay==execution){
+			return pos->entries[i-1].position;
+		}
+	}
+	return 0;
+}
+
+int iopos_set(int lp,FILE* file,unsigned int serial,long position){
+	unsigned int i;
+	iopos_entry* entries;
+	msg_t* event=iopos_event(lp);
+	iopos* pos=iopos_find(lp,file,serial,1);
+	if(pos==NULL){
+		return ENOMEM;
+	}
+	for(i=pos->len;i>0 && entry_is_after(&pos->entries[i-1],event);i--);
+	if(i>0 && entry_is_own(&pos->entries[i-1],event)){
+		pos->entries[i-1].replay=executing_replay(lp);
+		pos->entries[i-1].position=position;
+		return 0;
+	}
+	if(pos->len==pos->size){
+		entries=rsrealloc(pos->entries,sizeof(iopos_entry)*pos->size*2);
+		if(entries==NULL){
+			return ENOMEM;
+		}
+		pos->entries=entries;
+		pos->size*=2;
+	}
+	memmove(&pos->entries[i+1],&pos->entries[i],sizeof(iopos_entry)*(pos->len-i));
+	pos->entries[i].timestamp=event->timestamp;
+	pos->entries[i].tie_breaker=event->tie_breaker;
+	pos->entries[i].replay=executing_replay(lp);
+	pos->entries[i].position=position;
+	pos->len++;
+	return 0;
+}
+
+void iopos_replay(msg_t* event){
+	replayed=event;
+	if(event!=NULL){
+		replay=__sync_add_and_fetch(&replays,1);
+	}
+}
+
+void iopos_rollback(int lp,double timestamp,unsigned int tie_breaker){
+	iopos* pos;
+	for(pos=LPS[lp]->io_positions;pos!=NULL;pos=pos->next){
+		while(pos->len>0 && (pos->entries[pos->len-1].timestamp>timestamp || (pos->entries[pos->len-1].timestamp==timestamp && pos->entries[pos->len-1].tie_breaker>=tie_breaker))){
+			pos->len--;
+		}
+	}
+}
+
+void iopos_prune(int lp,double horizon){
+	unsigned int i;
+	iopos* pos;
+	for(pos=LPS[lp]->io_positions;pos!=NULL;pos=pos->next){
+		//the entries before the last committed one will never be seen again
+		for(i=0;i+1<pos->len && pos->entries[i+1].timestamp<horizon;i++);
+		if(i>0){
+			memmove(&pos->entries[0],&pos->entries[i],sizeof(iopos_entry)*(pos->len-i));
+			pos->len-=i;
+		}
+	}
+}
+
+void iopos_destroy(int lp){
+	iopos* pos;
+	while(LPS[lp]->io_positions!=NULL){
+		pos=LPS[lp]->io_positions;
+		LPS[lp]->io_positions=pos->next;
+		rsfree(pos->entries);
+		rsfree(pos);
+	}
+}
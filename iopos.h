@@ -0,0 +1,58 @@
+/** \file iopos.h
+ * Virtual file positions: each LP has its own position on each positioned stream, journaled by event so that it follows the rollbacks and the silent executions.
+ */
+
+#ifndef IOPOS_H_INCLUDED
+#define IOPOS_H_INCLUDED
+
+#include <stdio.h>
+#include <events.h>
+
+/** \brief Returns the position of an LP on a stream, as seen by the current event.
+ * \param[in] lp The LP.
+ * \param[in] file The stream.
+ * \param[in] serial The serial of the stream, a different serial means that the FILE has been reused by a new stream.
+ * \returns The position.
+ */
+long iopos_get(int lp,FILE* file,unsigned int serial);
+
+/** \brief Sets the position of an LP on a stream, from the current event on.
+ * \param[in] lp The LP.
+ * \param[in] file The stream.
+ * \param[in] serial The serial of the stream.
+ * \param[in] position The position.
+ * \returns 0 on success, ENOMEM if the journal cannot grow.
+ */
+int iopos_set(int lp,FILE* file,unsigned int serial,long position);
+
+/** \brief Makes the positions follow an event which is executed again by a silent execution of the thread.
+ * The event starts from the position it had before its first execution, its own positions are seen again only once it sets them.
+ * \param[in] event The event, NULL once the silent execution is over.
+ */
+void iopos_replay(msg_t* event);
+
+/** \brief Returns the event which is executing on an LP: the one executed again during a silent execution, current_msg otherwise.
+ * \param[in] lp The LP.
+ * \returns The event.
+ */
+msg_t* iopos_event(int lp);
+
+/** \brief Forgets the positions set by the events of an LP which are going to be executed again.
+ * \param[in] lp The LP.
+ * \param[in] timestamp The timestamp of the first event which will be executed again.
+ * \param[in] tie_breaker The tie breaker of the first event which will be executed again.
+ */
+void iopos_rollback(int lp,double timestamp,unsigned int tie_breaker);
+
+/** \brief Forgets the positions which cannot be seen anymore, the last one older than the horizon is kept.
+ * \param[in] lp The LP.
+ * \param[in] horizon The commit horizon of the LP.
+ */
+void iopos_prune(int lp,double horizon);
+
+/** \brief Releases the positions of an LP.
+ * \param[in] lp The LP.
+ */
+void iopos_destroy(int lp);
+
+#endif // IOPOS_H_INCLUDED
@@ -0,0 +1,302 @@
+/** \file iosink.c
+ * Implementation of the commit sinks.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "iosink.h"
+
+///Size of the header of a record in a shared memory ring.
+#define RING_HEADER 16
+
+iosink* iosink_new(const iosink_ops* ops,void* state){
+	iosink* sink;
+	if(ops==NULL || ops->write==NULL){
+		return NULL;
+	}
+	sink=malloc(sizeof(iosink));
+	if(sink==NULL){
+		return NULL;
+	}
+	sink->ops=ops;
+	sink->state=state;
+	return sink;
+}
+
+int iosink_write(iosink* sink,const iosink_record* records,unsigned int n){
+	if(n==0){
+		return 0;
+	}
+	return sink->ops->write(sink->state,records,n);
+}
+
+int iosink_flush(iosink* sink){
+	if(sink->ops->flush==NULL){
+		return 0;
+	}
+	return sink->ops->flush(sink->state);
+}
+
+int iosink_close(iosink* sink){
+	int res=0;
+	if(sink==NULL){
+		return 0;
+	}
+	if(sink->ops->close!=NULL){
+		res=sink->ops->close(sink->state);
+	}
+	free(sink);
+	return res;
+}
+
+/// \brief writes the records on the file descriptor with writev, retrying on partial writes and interrupts.
+static int fd_write(void* state,const iosink_record* records,unsigned int n){
+	struct iovec iov[IO_SINK_BATCH];
+	struct iovec* next=iov;
+	unsigned int i,len=0;
+	ssize_t written;
+	int res,fd=(int)(intptr_t)state;
+	for(i=0;i<n;i++){
+		if(len==IO_SINK_BATCH){
+			//more records than expected, the ones gathered so far are written first
+			res=fd_write(state,records+i-len,len);
+			if(res!=0){
+				return res;
+			}
+			len=0;
+		}
+		iov[len].iov_base=(void*)records[i].data;
+		iov[len].iov_len=records[i].len;
+		len++;
+	}
+	while(len>0){
+		written=writev(fd,next,len);
+		if(written<0){
+			if(errno==EINTR){
+				continue;
+			}
+			return errno;
+		}
+		while(len>0 && (size_t)written>=next->iov_len){
+			written-=next->iov_len;
+			next++;
+			len--;
+		}
+		if(len>0){
+			next->iov_base=(char*)next->iov_base+written;
+			next->iov_len-=written;
+		}
+	}
+	return 0;
+}
+
+static const iosink_ops fd_ops={fd_write,NULL,NULL};
+
+iosink* iosink_fd(int fd){
+	if(fd<0){
+		return NULL;
+	}
+	return iosink_new(&fd_ops,(void*)(intptr_t)fd);
+}
+
+///The state of a memory sink.
+typedef struct _memory_sink{
+	char** data; ///< Where the address of the buffer is published.
+	size_t* len; ///< Where the size of the buffer is published.
+	char* buffer; ///< The buffer.
+	size_t used; ///< The bytes in the buffer.
+	size_t size; ///< The capacity of the buffer.
+} memory_sink;
+
+static int memory_write(void* state,const iosink_record* records,unsigned int n){
+	memory_sink* memory=(memory_sink*)state;
+	unsigned int i;
+	size_t size;
+	char* buffer;
+	for(i=0;i<n;i++){
+		if(memory->used+records[i].len>memory->size){
+			size=memory->size*2;
+			if(size<memory->used+records[i].len){
+				size=memory->used+records[i].len;
+			}
+			buffer=realloc(memory->buffer,size);
+			if(buffer==NULL){
+				return ENOMEM;
+			}
+			memory->buffer=buffer;
+			memory->size=size;
+		}
+		memcpy(memory->buffer+memory->used,records[i].data,records[i].len);
+		memory->used+=records[i].len;
+	}
+	*memory->data=memory->buffer;
+	*memory->len=memory->used;
+	return 0;
+}
+
+static int memory_close(void* state){
+	//the buffer belongs to the caller
+	free(state);
+	return 0;
+}
+
+static const iosink_ops memory_ops={memory_write,NULL,memory_close};
+
+iosink* iosink_memory(char** data,size_t* len){
+	iosink* sink;
+	memory_sink* memory;
+	if(data==NULL || len==NULL){
+		return NULL;
+	}
+	memory=calloc(1,sizeof(memory_sink));
+	if(memory==NULL){
+		return NULL;
+	}
+	memory->data=data;
+	memory->len=len;
+	*data=NULL;
+	*len=0;
+	sink=iosink_new(&memory_ops,memory);
+	if(sink==NULL){
+		free(memory);
+	}
+	return sink;
+}
+
+///The state of a callback sink.
+typedef struct _callback_sink{
+	iosink_callback_fn fn; ///< The function.
+	void* arg; ///< The argument of the function.
+} callback_sink;
+
+static int callback_write(void* state,const iosink_record* records,unsigned int n){
+	callback_sink* callback=(callback_sink*)state;
+	unsigned int i;
+	int res;
+	for(i=0;i<n;i++){
+		res=callback->fn(callback->arg,records[i].timestamp,records[i].data,records[i].len);
+		if(res!=0){
+			return res;
+		}
+	}
+	return 0;
+}
+
+static int callback_close(void* state){
+	free(state);
+	return 0;
+}
+
+static const iosink_ops callback_ops={callback_write,NULL,callback_close};
+
+iosink* iosink_callback(iosink_callback_fn fn,void* arg){
+	iosink* sink;
+	callback_sink* callback;
+	if(fn==NULL){
+		return NULL;
+	}
+	callback=malloc(sizeof(callback_sink));
+	if(callback==NULL){
+		return NULL;
+	}
+	callback->fn=fn;
+	callback->arg=arg;
+	sink=iosink_new(&callback_ops,callback);
+	if(sink==NULL){
+		free(callback);
+	}
+	return sink;
+}
+
+///The state of a shared memory sink.
+typedef struct _shm_sink{
+	iosink_ring* ring; ///< The mapped ring.
+	size_t map_len; ///< The size of the mapping.
+} shm_sink;
+
+static int shm_write(void* state,const iosink_record* records,unsigned int n){
+	iosink_ring* ring=((shm_sink*)state)->ring;
+	uint64_t head=ring->head,pos,skip,need;
+	uint32_t header[2];
+	unsigned int i;
+	for(i=0;i<n;i++){
+		need=RING_HEADER+((records[i].len+7)&~(uint64_t)7);
+		pos=head%ring->size;
+		//a record never wraps around, the rest of the data is skipped
+		skip=pos+need>ring->size ? ring->size-pos : 0;
+		if(skip+need>ring->size-(head-ring->tail)){
+			ring->dropped++;
+			continue;
+		}
+		if(skip>=RING_HEADER){
+			header[0]=IOSINK_RING_WRAP;
+			memcpy(ring->data+pos,header,sizeof(header));
+		}
+		head+=skip;
+		pos=head%ring->size;
+		header[0]=records[i].len;
+		header[1]=0;
+		memcpy(ring->data+pos,header,sizeof(header));
+		memcpy(ring->data+pos+sizeof(header),&records[i].timestamp,sizeof(double));
+		memcpy(ring->data+pos+RING_HEADER,records[i].data,records[i].len);
+		head+=need;
+	}
+	//the reader must see the records before the new head
+	__sync_synchronize();
+	ring->head=head;
+	return 0;
+}
+
+static int shm_close(void* state){
+	shm_sink* shm=(shm_sink*)state;
+	int res=munmap(shm->ring,shm->map_len);
+	free(shm);
+	return res==0 ? 0 : errno;
+}
+
+static const iosink_ops shm_ops={shm_write,NULL,shm_close};
+
+iosink* iosink_shm(const char* name,size_t size){
+	iosink* sink;
+	shm_sink* shm;
+	void* map;
+	int fd;
+	size=(size+7)&~(size_t)7;
+	if(name==NULL || size<RING_HEADER){
+		return NULL;
+	}
+	fd=shm_open(name,O_RDWR|O_CREAT|O_TRUNC,0644);
+	if(fd<0){
+		return NULL;
+	}
+	if(ftruncate(fd,sizeof(iosink_ring)+size)!=0){
+		close(fd);
+		return NULL;
+	}
+	map=mmap(NULL,sizeof(iosink_ring)+size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	//the mapping keeps the object alive
+	close(fd);
+	if(map==MAP_FAILED){
+		return NULL;
+	}
+	shm=malloc(sizeof(shm_sink));
+	if(shm==NULL){
+		munmap(map,sizeof(iosink_ring)+size);
+		return NULL;
+	}
+	shm->ring=(iosink_ring*)map;
+	shm->map_len=sizeof(iosink_ring)+size;
+	//the object has been truncated, so the counters start from 0
+	shm->ring->size=size;
+	sink=iosink_new(&shm_ops,shm);
+	if(sink==NULL){
+		shm_close(shm);
+	}
+	return sink;
+}
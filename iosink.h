@@ -0,0 +1,111 @@
+/** \file iosink.h
+ * Commit sinks: the committed records of a stream can be handed to a sink instead of being written on a file, e.g. to feed a live consumer without going through the file system.
+ */
+
+#ifndef IOSINK_H_INCLUDED
+#define IOSINK_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef IO_SINK_BATCH
+///Maximum number of committed records handed to a sink with a single write.
+#define IO_SINK_BATCH 64
+#endif
+
+///A committed record.
+typedef struct _iosink_record{
+	double timestamp; ///< The timestamp of the event which wrote the record, negative for the writes of an ::IO_POLICY_PASSTHROUGH stream.
+	const char* data; ///< The record, it is valid only during the write.
+	size_t len; ///< The size of the record.
+} iosink_record;
+
+///The functions of a sink, they return 0 on success or an error code.
+typedef struct _iosink_ops{
+	int (*write)(void* state,const iosink_record* records,unsigned int n); ///< Receives committed records, in timestamp order.
+	int (*flush)(void* state); ///< Called each time every record older than the horizon has been handed to the sink, it can be NULL.
+	int (*close)(void* state); ///< Called when the stream is closed or at the end of the simulation, it can be NULL.
+} iosink_ops;
+
+///A sink.
+typedef struct _iosink{
+	const iosink_ops* ops; ///< The functions of the sink.
+	void* state; ///< The argument of the functions.
+} iosink;
+
+///The function of a callback sink, it receives one record at a time and returns 0 on success or an error code.
+typedef int (*iosink_callback_fn)(void* arg,double timestamp,const char* data,size_t len);
+
+/** \brief The header of the ring of a shared memory sink, followed by the data.
+ * Each record is a {uint32 len; uint32 unused; double timestamp} header followed by the data, padded to 8 bytes; head and tail are byte counters which only grow, their position in the data is taken modulo size.
+ * A record never wraps around: when the header does not fit before the end of the data, or its len is ::IOSINK_RING_WRAP, the next record starts at the beginning of the data.
+ * The reader consumes the records from tail to head in place, then advances tail; the records which do not fit in the free space are dropped and counted.
+ */
+typedef struct _iosink_ring{
+	volatile uint64_t head; ///< The bytes written by the simulation, updated after the records.
+	volatile uint64_t tail; ///< The bytes consumed by the reader, updated by the reader.
+	uint64_t size; ///< The size of the data, a multiple of 8.
+	volatile uint64_t dropped; ///< The number of records dropped because the ring was full.
+	char data[]; ///< The records.
+} iosink_ring;
+
+///The len of a record header which tells the reader to go back to the beginning of the data.
+#define IOSINK_RING_WRAP UINT32_MAX
+
+/** \brief Creates a sink with the given functions.
+ * \param[in] ops The functions, they must stay valid until the sink is closed.
+ * \param[in] state The argument of the functions.
+ * \returns The sink, or NULL on error.
+ */
+iosink* iosink_new(const iosink_ops* ops,void* state);
+
+/** \brief Creates a sink which writes the records on a file descriptor, the descriptor is not closed.
+ * \param[in] fd The file descriptor.
+ * \returns The sink, or NULL on error.
+ */
+iosink* iosink_fd(int fd);
+
+/** \brief Creates a sink which appends the records to a buffer in memory, mainly for tests.
+ * After each write *data and *len describe the buffer, which is left to the caller (to be released with free) when the sink is closed.
+ * \param[out] data Where the address of the buffer is stored.
+ * \param[out] len Where the size of the buffer is stored.
+ * \returns The sink, or NULL on error.
+ */
+iosink* iosink_memory(char** data,size_t* len);
+
+/** \brief Creates a sink which calls a function for each record.
+ * \param[in] fn The function.
+ * \param[in] arg The argument of the function.
+ * \returns The sink, or NULL on error.
+ */
+iosink* iosink_callback(iosink_callback_fn fn,void* arg);
+
+/** \brief Creates a sink which writes the records in a ring in POSIX shared memory, see ::iosink_ring.
+ * The shared memory object is created (or truncated) and it is not unlinked when the sink is closed, so a reader can still consume what is left.
+ * \param[in] name The name of the shared memory object, as for shm_open.
+ * \param[in] size The size of the data of the ring, it is rounded up to a multiple of 8.
+ * \returns The sink, or NULL on error.
+ */
+iosink* iosink_shm(const char* name,size_t size);
+
+/** \brief Hands records to a sink.
+ * \param[in] sink The sink.
+ * \param[in] records The records.
+ * \param[in] n The number of records.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iosink_write(iosink* sink,const iosink_record* records,unsigned int n);
+
+/** \brief Flushes a sink.
+ * \param[in] sink The sink.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iosink_flush(iosink* sink);
+
+/** \brief Closes and releases a sink.
+ * \param[in] sink The sink.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iosink_close(iosink* sink);
+
+#endif // IOSINK_H_INCLUDED
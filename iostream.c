@@ -0,0 +1,301 @@
+/** \file iostream.c
+ * Implementation of the stream registry, an open addressing hash table with linear probing which doubles when it is 3/4 full.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "iostream.h"
+#include "dymelor.h"
+
+///A slot which has been freed, the probing must go on.
+#define IOSTREAM_REMOVED ((FILE*)1)
+
+///A table of the registry, the entries are allocated separately so they do not move when the table grows.
+typedef struct _iostream_table{
+	unsigned int size; ///< The number of slots, a power of 2.
+	unsigned int used; ///< The slots which are not empty, removed entries included.
+	struct _iostream_table* old; ///< The table replaced by this one, it is never freed since a lookup could still be reading it.
+	iostream* slots[]; ///< The entries.
+} iostream_table;
+
+static iostream_table* volatile streams=NULL;
+///The entries which have been dropped from the table by a growth, to be reused.
+static iostream* streams_free=NULL;
+///Serializes the insertions, the lookups do not need it.
+static volatile int streams_lock=0;
+volatile unsigned int iostream_generation=0;
+///The serial of the last positioned stream.
+static volatile unsigned int streams_serial=0;
+
+/// \brief returns the first slot to probe for the given stream in a table with the given size.
+static unsigned int iostream_hash(FILE* file,unsigned int size){
+	uintptr_t key=(uintptr_t)file;
+	//the FILEs are allocated with the same alignment, so the lower bits are useless
+	key^=key>>17;
+	key*=0x9E3779B97F4A7C15ULL;
+	return (unsigned int)(key>>32)&(size-1);
+}
+
+/// \brief returns a new empty table with the given size, or NULL.
+static iostream_table* table_new(unsigned int size){
+	iostream_table* table=rsalloc(sizeof(iostream_table)+sizeof(iostream*)*size);
+	if(table==NULL){
+		return NULL;
+	}
+	table->size=size;
+	table->used=0;
+	table->old=NULL;
+	memset(table->slots,0,sizeof(iostream*)*size);
+	return table;
+}
+
+/** \brief Doubles the table, the caller must hold the lock.
+ * The removed entries are not moved, they go in the free list.
+ * \returns 0 on success, ENOMEM otherwise.
+ */
+static int table_grow(){
+	unsigned int i,slot;
+	iostream* entry;
+	iostream_table* table=table_new(streams->size*2);
+	if(table==NULL){
+		return ENOMEM;
+	}
+	for(i=0;i<streams->size;i++){
+		entry=streams->slots[i];
+		if(entry==NULL){
+			continue;
+		}
+		if(entry->file==IOSTREAM_REMOVED){
+			entry->next=streams_free;
+			streams_free=entry;
+			continue;
+		}
+		slot=iostream_hash(entry->file,table->size);
+		while(table->slots[slot]!=NULL){
+			slot=(slot+1)&(table->size-1);
+		}
+		table->slots[slot]=entry;
+		table->used++;
+	}
+	table->old=streams;
+	//the lookups see the new table only once it is complete
+	__sync_synchronize();
+	streams=table;
+	return 0;
+}
+
+iostream* iostream_get(FILE* file){
+	unsigned int i,slot;
+	iostream* entry;
+	iostream_table* table=streams;
+	if(table==NULL){
+		return NULL;
+	}
+	slot=iostream_hash(file,table->size);
+	for(i=0;i<table->size;i++){
+		entry=table->slots[slot];
+		if(entry==NULL){
+			return NULL;
+		}
+		if(entry->file==file){
+			return entry;
+		}
+		slot=(slot+1)&(table->size-1);
+	}
+	return NULL;
+}
+
+iostream* iostream_add(FILE* file){
+	unsigned int i,slot;
+	iostream* stream;
+	iostream* entry;
+	if(file==NULL){
+		return NULL;
+	}
+	while(!__sync_bool_compare_and_swap(&streams_lock,0,1));
+	if(streams==NULL){
+		streams=table_new(IO_MAX_STREAMS);
+	}
+	stream=iostream_get(file);
+	//the table is kept at most 3/4 full, so the probing stays short
+	if(stream==NULL && streams!=NULL && (streams->used+1)*4>streams->size*3){
+		table_grow();
+	}
+	if(stream==NULL && streams!=NULL){
+		slot=iostream_hash(file,streams->size);
+		for(i=0;i<streams->size;i++){
+			entry=streams->slots[slot];
+			if(entry==NULL || entry->file==IOSTREAM_REMOVED){
+				stream=entry;
+				if(stream==NULL && streams_free!=NULL){
+					stream=streams_free;
+					streams_free=stream->next;
+				}else if(stream==NULL){
+					stream=rsalloc(sizeof(iostream));
+					if(stream==NULL){
+						break;
+					}
+				}
+				//the file is set last, a removed slot must not look free to the lookups in the meantime
+				stream->policy=IO_POLICY_REVERSIBLE;
+				stream->flags=0;
+				stream->block=NULL;
+				stream->block_len=0;
+				stream->level=0;
+				stream->codec=NULL;
+				stream->opened=0;
+				stream->prefix=NULL;
+				stream->window=0;
+				stream->segment=-1;
+				stream->segment_fd=-1;
+				stream->index_fd=-1;
+				stream->index_every=0;
+				stream->pending=NULL;
+				stream->pending_len=0;
+				stream->pending_size=0;
+				stream->merger=NULL;
+				stream->owner=IOSTREAM_OWNER_NONE;
+				stream->serial=0;
+				stream->input=NULL;
+				stream->input_len=0;
+				stream->columnar=NULL;
+				stream->sink=NULL;
+				stream->sink_batch=NULL;
+				stream->sink_len=0;
+				stream->chunk=NULL;
+				stream->chunk_len=0;
+				pthread_mutex_init(&stream->chunk_mutex,NULL);
+				stream->next=NULL;
+				__sync_synchronize();
+				stream->file=file;
+				if(entry==NULL){
+					//a new entry is published only once it is complete
+					__sync_synchronize();
+					streams->slots[slot]=stream;
+					streams->used++;
+				}
+				break;
+			}
+			slot=(slot+1)&(streams->size-1);
+		}
+	}
+	__sync_lock_release(&streams_lock);
+	return stream;
+}
+
+void iostream_remove(FILE* file){
+	iostream* stream;
+	while(!__sync_bool_compare_and_swap(&streams_lock,0,1));
+	stream=iostream_get(file);
+	if(stream!=NULL && stream->input!=NULL){
+		munmap((void*)stream->input,stream->input_len);
+		stream->input=NULL;
+		stream->input_len=0;
+	}
+	if(stream!=NULL && stream->merger!=NULL){
+		stream->policy=IO_POLICY_REVERSIBLE;
+		stream->flags=0;
+		stream->owner=IOSTREAM_OWNER_NONE;
+		__sync_fetch_and_add(&iostream_generation,1);
+	}else if(stream!=NULL){
+		stream->file=IOSTREAM_REMOVED;
+		//the FILE could be reused for a stream with another policy
+		__sync_fetch_and_add(&iostream_generation,1);
+	}
+	__sync_lock_release(&streams_lock);
+}
+
+int iostream_set_policy(FILE* file,iostream_policy policy){
+	iostream* stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	stream->policy=policy;
+	__sync_fetch_and_add(&iostream_generation,1);
+	return 0;
+}
+
+int iostream_set_owner(FILE* file,int lp){
+	iostream* stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	stream->owner=lp;
+	return 0;
+}
+
+int iostream_set_positioned(FILE* file){
+	iostream* stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	stream->serial=__sync_add_and_fetch(&streams_serial,1);
+	stream->flags|=IOSTREAM_POSITIONED;
+	__sync_fetch_and_add(&iostream_generation,1);
+	return 0;
+}
+
+int iostream_set_input(FILE* file){
+	struct stat st;
+	void* input=NULL;
+	iostream* stream;
+	if(fstat(fileno(file),&st)!=0){
+		return errno;
+	}
+	if(st.st_size>0){
+		input=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fileno(file),0);
+		if(input==MAP_FAILED){
+			return errno;
+		}
+		//the first window is prefetched, the next ones are prefetched as the LPs read
+		madvise(input,(size_t)st.st_size<IO_INPUT_READAHEAD ? (size_t)st.st_size : IO_INPUT_READAHEAD,MADV_WILLNEED);
+	}
+	stream=iostream_add(file);
+	if(stream==NULL){
+		if(input!=NULL){
+			munmap(input,st.st_size);
+		}
+		return ENOMEM;
+	}
+	stream->input=input;
+	stream->input_len=st.st_size;
+	stream->flags|=IOSTREAM_INPUT;
+	__sync_fetch_and_add(&iostream_generation,1);
+	return 0;
+}
+
+iostream_policy iostream_get_policy(FILE* file){
+	iostream* stream=iostream_get(file);
+	if(stream==NULL){
+		return IO_POLICY_REVERSIBLE;
+	}
+	return stream->policy;
+}
+
+unsigned int iostream_slots(){
+	iostream_table* table=streams;
+	return table!=NULL ? table->size : 0;
+}
+
+iostream* iostream_slot(unsigned int slot){
+	iostream_table* table=streams;
+	if(table==NULL || slot>=table->size || table->slots[slot]==NULL || table->slots[slot]->file==IOSTREAM_REMOVED){
+		return NULL;
+	}
+	return table->slots[slot];
+}
+
+void iostream_foreach(void (*func)(iostream*)){
+	unsigned int i;
+	iostream* stream;
+	for(i=0;i<iostream_slots();i++){
+		stream=iostream_slot(i);
+		if(stream!=NULL){
+			func(stream);
+		}
+	}
+}
@@ -0,0 +1,190 @@
+/** \file iostream.h
+ * A registry which holds the per stream settings and state of the reversible I/O, indexed by FILE pointer.
+ */
+
+#ifndef IOSTREAM_H_INCLUDED
+#define IOSTREAM_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifndef IO_MAX_STREAMS
+///Initial number of slots of the stream registry, it must be a power of 2; the registry doubles when it is 3/4 full.
+#define IO_MAX_STREAMS 256
+#endif
+
+#ifndef IO_ORDER_PER_FILE
+///If set to 1 the committed records are ordered only within each file, every file has its own merge heap and can be executed independently.
+#define IO_ORDER_PER_FILE 0
+#endif
+
+#ifndef IO_DIRECT_ALIGN
+///Alignment (in bytes) of the offsets, sizes and buffers of the O_DIRECT writes.
+#define IO_DIRECT_ALIGN 4096
+#endif
+
+#ifndef IO_DIRECT_BLOCK
+///Size (in bytes) of the staging block of each O_DIRECT stream, it must be a multiple of ::IO_DIRECT_ALIGN.
+#define IO_DIRECT_BLOCK (1UL<<20)
+#endif
+
+///The committed records of the stream are written with O_DIRECT, bypassing the page cache.
+#define IOSTREAM_DIRECT 0x1
+///The committed records of the stream are compressed.
+#define IOSTREAM_COMPRESS 0x2
+///The committed records of the stream are split in segment files by simulated time window.
+#define IOSTREAM_SEGMENT 0x4
+///A sidecar index of the committed records of the stream is written.
+#define IOSTREAM_INDEX 0x8
+///The committed records of the stream are fixed size records, written in columns (see iocolumnar.h).
+#define IOSTREAM_COLUMNAR 0x40
+///The committed records of the stream are handed to a sink instead of the file (see iosink.h).
+#define IOSTREAM_SINK 0x80
+///The flags which require the committer to write the stream by itself.
+#define IOSTREAM_CUSTOM (IOSTREAM_DIRECT|IOSTREAM_COMPRESS|IOSTREAM_SEGMENT|IOSTREAM_INDEX|IOSTREAM_COLUMNAR|IOSTREAM_SINK)
+///The stream is a regular file opened by the model, each LP has its own virtual position on it (see iopos.h).
+#define IOSTREAM_POSITIONED 0x10
+///The stream is a regular file opened for reading, the reads are served from a mapping of the file.
+#define IOSTREAM_INPUT 0x20
+
+#ifndef IO_INPUT_READAHEAD
+///Size (in bytes) of the window of an input stream which is prefetched ahead of the cursor of the LP.
+#define IO_INPUT_READAHEAD (2UL<<20)
+#endif
+
+///How the wrappers handle the writes on a stream.
+typedef enum _iostream_policy{
+	IO_POLICY_REVERSIBLE=0, ///< The writes are buffered and executed in timestamp order once committed (the default).
+	IO_POLICY_PASSTHROUGH, ///< The writes are executed immediately, also by the events which will be rolled back.
+	IO_POLICY_DISCARD, ///< The writes are discarded.
+	IO_POLICY_UNORDERED, ///< The committed writes are executed as soon as they are collected, not in timestamp order, the stream is never inspected.
+	IO_POLICY_UNDO ///< The writes are executed immediately and undone on rollback, for seekable streams written by a single LP.
+} iostream_policy;
+
+///An entry of the sidecar index, as it is written in the index file.
+typedef struct _iostream_index_entry{
+	double timestamp; ///< The timestamp of the record.
+	uint64_t offset; ///< The offset of the record in the stream.
+} iostream_index_entry;
+
+struct _iocompress;
+struct _iocolumnar;
+struct _iosink;
+struct _iobuffer;
+struct _io_merger;
+
+///The stream has not been declared private by any LP.
+#define IOSTREAM_OWNER_NONE -1
+///The stream is written by more than one LP.
+#define IOSTREAM_OWNER_SHARED -2
+
+///The settings and the state of a stream.
+typedef struct _iostream{
+	FILE* file; ///< The stream, NULL if the slot is free.
+	iostream_policy policy; ///< How the wrappers handle the writes on the stream.
+	unsigned int flags; ///< The IOSTREAM_* flags of the stream.
+	char* block; ///< The aligned staging block of an O_DIRECT stream.
+	size_t block_len; ///< The bytes used in the staging block.
+	int level; ///< The compression level of a compressed stream.
+	struct _iocompress* codec; ///< The compression state of a compressed stream.
+	unsigned int opened; ///< 1 if the custom settings have been applied by the committer.
+	char* prefix; ///< The path prefix of the segment files of a segmented stream.
+	double window; ///< The simulated time covered by each segment.
+	long segment; ///< The index of the open segment, -1 if no segment is open.
+	int segment_fd; ///< The file descriptor of the open segment.
+	int index_fd; ///< The file descriptor of the sidecar index.
+	size_t index_every; ///< The minimum distance (in bytes) between two entries of the index.
+	uint64_t offset; ///< The offset of the next byte emitted on the stream.
+	uint64_t written; ///< The offset of the next byte which will reach the file.
+	uint64_t next_entry; ///< The offset from which the next entry of the index can be added.
+	iostream_index_entry* pending; ///< The entries which point to data that has not reached the file yet.
+	unsigned int pending_len; ///< The number of pending entries.
+	unsigned int pending_size; ///< The capacity of pending.
+	struct _io_merger* merger; ///< The merge heap of the stream, with ::IO_ORDER_PER_FILE.
+	volatile int owner; ///< The only LP which writes on the stream, ::IOSTREAM_OWNER_NONE or ::IOSTREAM_OWNER_SHARED.
+	unsigned int serial; ///< Identifies a positioned stream, so that the positions of a closed stream with the same FILE are not reused.
+	const char* input; ///< The mapping of an input stream, NULL if the file is empty.
+	size_t input_len; ///< The size of the mapping.
+	struct _iocolumnar* columnar; ///< The columnar state of a columnar stream.
+	struct _iosink* sink; ///< The sink of the stream.
+	struct _iobuffer** sink_batch; ///< The records which have not been handed to the sink yet.
+	unsigned int sink_len; ///< The number of records in sink_batch.
+	char* chunk; ///< The records of an unordered or private stream which have been collected but not written yet.
+	size_t chunk_len; ///< The bytes used in the chunk.
+	pthread_mutex_t chunk_mutex; ///< Serializes the threads which fill or write the chunk, the holder may be blocked in a write.
+	struct _iostream* next; ///< The next free entry, once the entry has been dropped from the registry.
+} iostream;
+
+///Incremented each time a stream is added, removed or changes policy, so the caches of the policies can be invalidated.
+extern volatile unsigned int iostream_generation;
+
+/** \brief Returns the registry entry of a stream.
+ * \param[in] file The stream.
+ * \returns The entry, or NULL if the stream has default settings.
+ */
+iostream* iostream_get(FILE* file);
+
+/** \brief Adds a stream to the registry, if it is not there already.
+ * \param[in] file The stream.
+ * \returns The entry, or NULL if it cannot be allocated.
+ */
+iostream* iostream_add(FILE* file);
+
+/** \brief Sets the policy of a stream.
+ * \param[in] file The stream.
+ * \param[in] policy The policy.
+ * \returns 0 on success, ENOMEM if the stream cannot be added to the registry.
+ */
+int iostream_set_policy(FILE* file,iostream_policy policy);
+
+/** \brief Declares that a stream is written by a single LP.
+ * \param[in] file The stream.
+ * \param[in] lp The LP.
+ * \returns 0 on success, ENOMEM if the stream cannot be added to the registry.
+ */
+int iostream_set_owner(FILE* file,int lp);
+
+/** \brief Marks a stream as positioned, to be called when it is opened.
+ * \param[in] file The stream.
+ * \returns 0 on success, ENOMEM if the stream cannot be added to the registry.
+ */
+int iostream_set_positioned(FILE* file);
+
+/** \brief Maps an input stream in memory, to be called when it is opened.
+ * \param[in] file The stream.
+ * \returns 0 on success, otherwise an error code.
+ */
+int iostream_set_input(FILE* file);
+
+/** \brief Returns the policy of a stream.
+ * \param[in] file The stream.
+ * \returns The policy of the stream, ::IO_POLICY_REVERSIBLE if it has not been set.
+ */
+iostream_policy iostream_get_policy(FILE* file);
+
+/** \brief Removes a stream from the registry, to be called when the stream is closed.
+ * A stream with a merge heap only gets the default settings back, since the heap could already hold records of a new stream with the same FILE.
+ * The mapping of an input stream is released.
+ * \param[in] file The stream.
+ */
+void iostream_remove(FILE* file);
+
+/** \brief Returns the number of slots of the registry, which grows as the streams are added.
+ * \returns The number of slots.
+ */
+unsigned int iostream_slots();
+
+/** \brief Returns the stream in the given slot of the registry.
+ * The entries can move to other slots when the registry grows, so a scan concurrent with an insertion could miss a stream or see it twice.
+ * \param[in] slot The slot, from 0 to iostream_slots()-1.
+ * \returns The stream, or NULL if the slot is free or out of the registry.
+ */
+iostream* iostream_slot(unsigned int slot);
+
+/** \brief Calls the given function on each registered stream.
+ * \param[in] func The function to call.
+ */
+void iostream_foreach(void (*func)(iostream*));
+
+#endif // IOSTREAM_H_INCLUDED
@@ -0,0 +1,1536 @@
+#define _GNU_SOURCE
+/** \file iowriter.c
+ * Implementation of the writer stage of the reversible I/O.
+ */
+
+#include <asm-generic/errno-base.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#if IO_URING==1
+#include <liburing.h>
+#endif
+#if IO_WRITER_THREAD==1
+#include <pthread.h>
+#endif
+
+#include "iowriter.h"
+#include "iostream.h"
+#include "iocompress.h"
+#include "iocolumnar.h"
+#include "iosink.h"
+#include "wrappers.h"
+#include "iopool.h"
+
+#include <fcntl.h>
+#include <math.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static int stream_close(iostream* stream);
+static void stream_drop(iostream* stream);
+
+///The horizon used by ::segment_expire.
+static double segment_horizon;
+
+///The file of the gathered records.
+static FILE* batch_file=NULL;
+///The chunks to be written by writev.
+static struct iovec batch_iov[IOV_MAX];
+///The iobuffers which own the chunks, they will be destroyed after the writev.
+static iobuffer* batch_bufs[IOV_MAX];
+///The number of gathered records.
+static int batch_len=0;
+///The number of gathered bytes.
+static size_t batch_bytes=0;
+
+#if IO_URING==1
+///The ring used to submit the writes.
+static struct io_uring ring;
+///1 if the ring can be used, 0 if it has not been initialized yet, -1 if the writes must fall back to writev.
+static int ring_state=0;
+///The registered staging buffers.
+static char* staging[IO_URING_BUFS];
+///The bytes used in each staging buffer of the chain in flight.
+static size_t staging_len[IO_URING_BUFS];
+///The number of staging buffers submitted in the chain in flight, 0 if nothing is in flight.
+static int inflight=0;
+///The file descriptor of the chain in flight.
+static int inflight_fd=-1;
+#endif
+
+#if IO_WRITER_THREAD==1
+///A set of records which are filled by the committer or written by the writer thread.
+typedef struct _iowriter_stage{
+	int fd[IO_WRITER_STAGE_RECORDS]; ///< The file descriptor of each record.
+	struct iovec iov[IO_WRITER_STAGE_RECORDS]; ///< The content of each record.
+	iobuffer* bufs[IO_WRITER_STAGE_RECORDS]; ///< The iobuffers which own the contents.
+	int len; ///< The number of records in the stage.
+	size_t bytes; ///< The number of bytes in the stage.
+	int error; ///< The first error of the writes of the stage, ::IOBUF_OP_SUCCESS if there is none.
+} iowriter_stage;
+
+///The two stages, while one is filled by the committer the other one is written by the writer thread.
+static iowriter_stage* stages=NULL;
+///The stage filled by the committer.
+static int fill_stage=0;
+///1 if the other stage has been handed to the writer thread and has not been written yet.
+static int drain_pending=0;
+///Set to ask the writer thread to terminate.
+static int writer_stop=0;
+///The first error of the stages written by the writer thread which has not been reported to the committer yet.
+static int writer_error=IOBUF_OP_SUCCESS;
+static pthread_t writer;
+static pthread_mutex_t stage_mutex=PTHREAD_MUTEX_INITIALIZER;
+///Signaled when a stage is handed to the writer thread.
+static pthread_cond_t stage_full=PTHREAD_COND_INITIALIZER;
+///Signaled when the writer thread has written a stage.
+static pthread_cond_t stage_empty=PTHREAD_COND_INITIALIZER;
+#endif
+
+/** \brief Writes the whole iovec array, retrying on partial writes and interrupts.
+ * \param[in] fd The file descriptor where the chunks must be written.
+ * \param[in,out] iov The chunks to write, they are modified in case of partial writes.
+ * \param[in] iovcnt The number of chunks.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int writev_all(int fd,struct iovec* iov,int iovcnt){
+	ssize_t written;
+	while(iovcnt>0){
+		written=writev(fd,iov,iovcnt);
+		if(written<0){
+			if(errno==EINTR){
+				continue;
+			}
+			return errno;
+		}
+		//we skip the chunks that have been completely written
+		while(iovcnt>0 && (size_t)written>=iov->iov_len){
+			written-=iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt>0){
+			iov->iov_base=(char*)iov->iov_base+written;
+			iov->iov_len-=written;
+		}
+	}
+	return IOBUF_OP_SUCCESS;
+}
+
+#if IO_URING==1
+/** \brief Initializes the ring and registers the staging buffers.
+ * If anything fails (e.g. the kernel does not support io_uring or does not keep the file position for offset -1) the writer falls back to writev.
+ */
+static void ring_init(){
+	int i;
+	struct iovec iov[IO_URING_BUFS];
+	struct io_uring_params params;
+	ring_state=-1;
+	memset(&params,0,sizeof(params));
+	if(io_uring_queue_init_params(IO_URING_BUFS,&ring,&params)<0){
+		return;
+	}
+	//the writes are appended using the file position, as writev does
+	if(!(params.features & IORING_FEAT_RW_CUR_POS)){
+		io_uring_queue_exit(&ring);
+		return;
+	}
+	for(i=0;i<IO_URING_BUFS;i++){
+		if(posix_memalign((void**)&staging[i],getpagesize(),IO_URING_BUF_SIZE)!=0){
+			while(--i>=0){
+				free(staging[i]);
+			}
+			io_uring_queue_exit(&ring);
+			return;
+		}
+		iov[i].iov_base=staging[i];
+		iov[i].iov_len=IO_URING_BUF_SIZE;
+	}
+	if(io_uring_register_buffers(&ring,iov,IO_URING_BUFS)<0){
+		for(i=0;i<IO_URING_BUFS;i++){
+			free(staging[i]);
+		}
+		io_uring_queue_exit(&ring);
+		return;
+	}
+	ring_state=1;
+}
+
+/// \brief releases the ring and its registered staging buffers, if they have been initialized.
+static void ring_destroy(){
+	int i;
+	if(ring_state==1){
+		io_uring_unregister_buffers(&ring);
+		io_uring_queue_exit(&ring);
+		for(i=0;i<IO_URING_BUFS;i++){
+			free(staging[i]);
+		}
+	}
+	ring_state=0;
+}
+
+/** \brief Waits for the chain in flight and reaps its completions, after that the staging buffers can be reused.
+ * A short write breaks the chain: the rest of the short buffer and the buffers which have been canceled are written synchronously, in order.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int ring_wait(){
+	int i,res=IOBUF_OP_SUCCESS;
+	int written[IO_URING_BUFS];
+	struct io_uring_cqe* cqe;
+	struct iovec rest;
+	//if a completion cannot be reaped we cannot know what has been written, so we avoid rewriting it
+	for(i=0;i<inflight;i++){
+		written[i]=staging_len[i];
+	}
+	for(i=0;i<inflight;i++){
+		while((res=io_uring_wait_cqe(&ring,&cqe))==-EINTR);
+		if(res<0){
+			break;
+		}
+		written[io_uring_cqe_get_data64(cqe)]=cqe->res;
+		io_uring_cqe_seen(&ring,cqe);
+	}
+	res=IOBUF_OP_SUCCESS;
+	for(i=0;i<inflight;i++){
+		if(written[i]<0){
+			written[i]=0;
+		}
+		if((size_t)written[i]<staging_len[i] && res==IOBUF_OP_SUCCESS){
+			rest.iov_base=staging[i]+written[i];
+			rest.iov_len=staging_len[i]-written[i];
+			res=writev_all(inflight_fd,&rest,1);
+		}
+	}
+	inflight=0;
+	inflight_fd=-1;
+	return res;
+}
+
+/** \brief Stops using the ring after a failed submission.
+ * The staged chain and the records which have not been staged yet are written synchronously.
+ * \param[in] next The first record which has not been staged.
+ * \param[in] off How much of the first record has already been staged.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int ring_fallback(int next,size_t off){
+	int i,res=IOBUF_OP_SUCCESS;
+	struct iovec chunk;
+	for(i=0;i<inflight && res==IOBUF_OP_SUCCESS;i++){
+		chunk.iov_base=staging[i];
+		chunk.iov_len=staging_len[i];
+		res=writev_all(inflight_fd,&chunk,1);
+	}
+	inflight=0;
+	inflight_fd=-1;
+	//the queued writes are discarded with the ring, the streams are left untouched
+	ring_destroy();
+	ring_state=-1;
+	if(res!=IOBUF_OP_SUCCESS || next>=batch_len){
+		return res;
+	}
+	batch_iov[next].iov_base=(char*)batch_iov[next].iov_base+off;
+	batch_iov[next].iov_len-=off;
+	return writev_all(fileno(batch_file),batch_iov+next,batch_len-next);
+}
+
+/** \brief Copies the gathered records in the staging buffers and submits them as a chain of linked writes.
+ * The function returns as soon as the last chain has been submitted, the completions will be reaped by the next call to ::ring_wait.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int ring_submit(){
+	int i,res;
+	size_t off=0,chunk;
+	int fd=fileno(batch_file);
+	struct io_uring_sqe* sqe;
+	i=0;
+	while(i<batch_len){
+		//the staging buffers are released only after their completions have been reaped
+		res=ring_wait();
+		if(res!=IOBUF_OP_SUCCESS){
+			return res;
+		}
+		//we pack the records in the staging buffers, a record can span more buffers
+		while(i<batch_len && inflight<IO_URING_BUFS){
+			staging_len[inflight]=0;
+			while(i<batch_len && staging_len[inflight]<IO_URING_BUF_SIZE){
+				chunk=batch_iov[i].iov_len-off;
+				if(chunk>IO_URING_BUF_SIZE-staging_len[inflight]){
+					chunk=IO_URING_BUF_SIZE-staging_len[inflight];
+				}
+				memcpy(staging[inflight]+staging_len[inflight],(char*)batch_iov[i].iov_base+off,chunk);
+				staging_len[inflight]+=chunk;
+				off+=chunk;
+				if(off==batch_iov[i].iov_len){
+					off=0;
+					i++;
+				}
+			}
+			sqe=io_uring_get_sqe(&ring);
+			io_uring_prep_write_fixed(sqe,fd,staging[inflight],staging_len[inflight],-1,inflight);
+			io_uring_sqe_set_data64(sqe,inflight);
+			//the writes must reach the file in order
+			io_uring_sqe_set_flags(sqe,IOSQE_IO_LINK);
+			inflight++;
+		}
+		//the last write closes the chain
+		io_uring_sqe_set_flags(sqe,0);
+		inflight_fd=fd;
+		while((res=io_uring_submit(&ring))==-EINTR);
+		if(res<0){
+			return ring_fallback(i,off);
+		}
+	}
+	return IOBUF_OP_SUCCESS;
+}
+#endif
+
+#if IO_WRITER_THREAD==1
+/** \brief Writes the records of a stage, the consecutive records for the same file are written with a single writev.
+ * The first error is recorded in the stage.
+ * \param[in,out] stage The stage to write, it will be left empty.
+ */
+static void stage_write(iowriter_stage* stage){
+	int first,last,i,res;
+	for(first=0;first<stage->len;first=last){
+		last=first+1;
+		while(last<stage->len && last-first<IOV_MAX && stage->fd[last]==stage->fd[first]){
+			last++;
+		}
+		res=writev_all(stage->fd[first],stage->iov+first,last-first);
+		if(stage->error==IOBUF_OP_SUCCESS){
+			stage->error=res;
+		}
+	}
+	for(i=0;i<stage->len;i++){
+		destroy_iobuffer(stage->bufs[i]);
+	}
+	stage->len=0;
+	stage->bytes=0;
+}
+
+/** \brief Main loop of the writer thread, it writes the stages handed over by the committer. */
+static void* writer_loop(void* args){
+	(void)args;
+	pthread_mutex_lock(&stage_mutex);
+	while(1){
+		while(!drain_pending && !writer_stop){
+			pthread_cond_wait(&stage_full,&stage_mutex);
+		}
+		if(!drain_pending){
+			break;
+		}
+		pthread_mutex_unlock(&stage_mutex);
+		stage_write(&stages[1-fill_stage]);
+		pthread_mutex_lock(&stage_mutex);
+		if(writer_error==IOBUF_OP_SUCCESS){
+			writer_error=stages[1-fill_stage].error;
+		}
+		stages[1-fill_stage].error=IOBUF_OP_SUCCESS;
+		drain_pending=0;
+		pthread_cond_broadcast(&stage_empty);
+	}
+	pthread_mutex_unlock(&stage_mutex);
+	return NULL;
+}
+
+/** \brief Returns the first error of the writer thread which has not been reported yet, the caller must hold stage_mutex.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int stage_error(){
+	int res=writer_error;
+	writer_error=IOBUF_OP_SUCCESS;
+	return res;
+}
+
+/** \brief Hands the stage filled by the committer to the writer thread.
+ * If the writer thread is still writing the other stage the committer waits for it, so the memory held by the stages is bounded.
+ * \returns The first error of the stages written by the writer thread since the last report, or ::IOBUF_OP_SUCCESS.
+ */
+static int stage_swap(){
+	int res;
+	pthread_mutex_lock(&stage_mutex);
+	if(stages[fill_stage].len==0){
+		res=stage_error();
+		pthread_mutex_unlock(&stage_mutex);
+		return res;
+	}
+	while(drain_pending){
+		pthread_cond_wait(&stage_empty,&stage_mutex);
+	}
+	fill_stage=1-fill_stage;
+	drain_pending=1;
+	pthread_cond_signal(&stage_full);
+	res=stage_error();
+	pthread_mutex_unlock(&stage_mutex);
+	return res;
+}
+
+/** \brief Waits until the writer thread has written everything it has been handed.
+ * \returns The first error of the stages written by the writer thread since the last report, or ::IOBUF_OP_SUCCESS.
+ */
+static int stage_wait(){
+	int res;
+	pthread_mutex_lock(&stage_mutex);
+	while(drain_pending){
+		pthread_cond_wait(&stage_empty,&stage_mutex);
+	}
+	res=stage_error();
+	pthread_mutex_unlock(&stage_mutex);
+	return res;
+}
+
+/** \brief Allocates the stages and starts the writer thread, if it is not running yet.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int stage_init(){
+	if(stages!=NULL){
+		return IOBUF_OP_SUCCESS;
+	}
+	stages=calloc(2,sizeof(iowriter_stage));
+	if(stages==NULL){
+		return ENOMEM;
+	}
+	if(pthread_create(&writer,NULL,writer_loop,NULL)!=0){
+		free(stages);
+		stages=NULL;
+		return EAGAIN;
+	}
+	return IOBUF_OP_SUCCESS;
+}
+
+/** \brief Moves the gathered records in the stage filled by the committer, which is handed to the writer thread once it holds ::IO_WRITER_SWAP_SIZE bytes.
+ * The records are owned by the writer thread afterwards, even if an error is returned.
+ * \returns ::IOBUF_OP_SUCCESS or the first error of the writer thread which has not been reported yet.
+ */
+static int stage_fill(){
+	int i,fd,res=IOBUF_OP_SUCCESS,err;
+	iowriter_stage* stage;
+	fd=fileno(batch_file);
+	for(i=0;i<batch_len;i++){
+		if(stages[fill_stage].len==IO_WRITER_STAGE_RECORDS){
+			err=stage_swap();
+			if(res==IOBUF_OP_SUCCESS){
+				res=err;
+			}
+		}
+		stage=&stages[fill_stage];
+		stage->fd[stage->len]=fd;
+		stage->iov[stage->len]=batch_iov[i];
+		stage->bufs[stage->len]=batch_bufs[i];
+		stage->bytes+=batch_iov[i].iov_len;
+		stage->len++;
+	}
+	if(stages[fill_stage].bytes>=IO_WRITER_SWAP_SIZE){
+		err=stage_swap();
+		if(res==IOBUF_OP_SUCCESS){
+			res=err;
+		}
+	}
+	return res;
+}
+#endif
+
+/** \brief Writes the whole iovec array at the given offset, retrying on partial writes and interrupts.
+ * \param[in] fd The file descriptor where the chunks must be written.
+ * \param[in,out] iov The chunks to write, they are modified in case of partial writes.
+ * \param[in] iovcnt The number of chunks.
+ * \param[in] offset The offset of the first chunk.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int pwritev_all(int fd,struct iovec* iov,int iovcnt,off_t offset){
+	ssize_t written;
+	while(iovcnt>0){
+		written=pwritev(fd,iov,iovcnt,offset);
+		if(written<0){
+			if(errno==EINTR){
+				continue;
+			}
+			return errno;
+		}
+		offset+=written;
+		while(iovcnt>0 && (size_t)written>=iov->iov_len){
+			written-=iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt>0){
+			iov->iov_base=(char*)iov->iov_base+written;
+			iov->iov_len-=written;
+		}
+	}
+	return IOBUF_OP_SUCCESS;
+}
+
+/// \brief returns the size of a record.
+static size_t record_len(iobuffer* buf){
+	return buf->buffer_elements_num*buf->buffer_elements_size;
+}
+
+/** \brief Writes a set of positioned records, sorted by offset and with the adjacent ones coalesced in a single pwritev.
+ * If two records overlap they are written one by one in timestamp order, so that the newest one wins.
+ * \param[in,out] batch The records, it is left empty.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int positioned_flush(iowriter_positioned* batch){
+	int i,j,k,overlap=0,res=IOBUF_OP_SUCCESS,err;
+	iobuffer* sorted[IO_POSITIONED_BATCH];
+	struct iovec iov[IO_POSITIONED_BATCH];
+	long start,end=0;
+	if(batch->len==0){
+		return IOBUF_OP_SUCCESS;
+	}
+	fflush(batch->file);
+	//insertion sort, the batch is small and usually almost sorted
+	for(i=0;i<batch->len;i++){
+		for(j=i;j>0 && sorted[j-1]->file_position>batch->bufs[i]->file_position;j--){
+			sorted[j]=sorted[j-1];
+		}
+		sorted[j]=batch->bufs[i];
+	}
+	for(i=0;i<batch->len && !overlap;i++){
+		overlap=i>0 && sorted[i]->file_position<end;
+		if(sorted[i]->file_position+(long)record_len(sorted[i])>end){
+			end=sorted[i]->file_position+record_len(sorted[i]);
+		}
+	}
+	if(overlap){
+		for(i=0;i<batch->len;i++){
+			iov[0].iov_base=batch->bufs[i]->buffer;
+			iov[0].iov_len=record_len(batch->bufs[i]);
+			err=pwritev_all(fileno(batch->file),iov,1,batch->bufs[i]->file_position);
+			if(res==IOBUF_OP_SUCCESS){
+				res=err;
+			}
+		}
+	}else{
+		for(i=0;i<batch->len;i+=k){
+			start=sorted[i]->file_position;
+			end=start;
+			for(k=0;i+k<batch->len && sorted[i+k]->file_position==end;k++){
+				iov[k].iov_base=sorted[i+k]->buffer;
+				iov[k].iov_len=record_len(sorted[i+k]);
+				end+=iov[k].iov_len;
+			}
+			err=pwritev_all(fileno(batch->file),iov,k,start);
+			if(res==IOBUF_OP_SUCCESS){
+				res=err;
+			}
+		}
+	}
+	for(i=0;i<batch->len;i++){
+		destroy_iobuffer(batch->bufs[i]);
+	}
+	batch->file=NULL;
+	batch->len=0;
+	return res;
+}
+
+/** \brief Adds a positioned record to a set, the set is written first if it belongs to another file or if it is full.
+ * \param[in,out] batch The set.
+ * \param[in] buf The record, it is owned by the set from now on.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int positioned_add(iowriter_positioned* batch,iobuffer* buf){
+	int res=IOBUF_OP_SUCCESS;
+	if(record_len(buf)==0){
+		destroy_iobuffer(buf);
+		return IOBUF_OP_SUCCESS;
+	}
+	if(batch->file!=buf->file || batch->len==IO_POSITIONED_BATCH){
+		res=positioned_flush(batch);
+		batch->file=buf->file;
+	}
+	batch->bufs[batch->len++]=buf;
+	return res;
+}
+
+///The positioned records gathered by the committer.
+static iowriter_positioned positioned_batch;
+
+/** \brief Writes the gathered records, without waiting for their completion if the io_uring backend or the writer thread are used.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int batch_submit(){
+	int i,res=IOBUF_OP_SUCCESS;
+	if(batch_len==0){
+		return IOBUF_OP_SUCCESS;
+	}
+#if IO_WRITER_THREAD==1
+	if(stage_init()==IOBUF_OP_SUCCESS){
+		//the records are owned by the writer thread now
+		res=stage_fill();
+		batch_file=NULL;
+		batch_len=0;
+		batch_bytes=0;
+		return res;
+	}
+	res=writev_all(fileno(batch_file),batch_iov,batch_len);
+#elif IO_URING==1
+	if(ring_state==0){
+		ring_init();
+	}
+	if(ring_state==1){
+		res=ring_submit();
+	}else{
+		res=writev_all(fileno(batch_file),batch_iov,batch_len);
+	}
+#else
+	res=writev_all(fileno(batch_file),batch_iov,batch_len);
+#endif
+	//the records have been copied or written, so they can be released
+	for(i=0;i<batch_len;i++){
+		destroy_iobuffer(batch_bufs[i]);
+	}
+	batch_file=NULL;
+	batch_len=0;
+	batch_bytes=0;
+	return res;
+}
+
+int iowriter_flush(){
+	int res=positioned_flush(&positioned_batch);
+	int submit_res=batch_submit();
+	if(res==IOBUF_OP_SUCCESS){
+		res=submit_res;
+	}
+#if IO_WRITER_THREAD==1
+	if(stages!=NULL){
+		int swap_res=stage_swap();
+		int wait_res=stage_wait();
+		if(res==IOBUF_OP_SUCCESS){
+			res=swap_res!=IOBUF_OP_SUCCESS ? swap_res : wait_res;
+		}
+	}
+#elif IO_URING==1
+	if(ring_state==1){
+		int wait_res=ring_wait();
+		if(res==IOBUF_OP_SUCCESS){
+			res=wait_res;
+		}
+	}
+#endif
+	return res;
+}
+
+int iowriter_end_batch(){
+#if IO_FLUSH_POLICY==IO_FLUSH_BATCH
+	positioned_flush(&positioned_batch);
+	return batch_submit();
+#else
+	return IOBUF_OP_SUCCESS;
+#endif
+}
+
+void iowriter_destroy(){
+	//the tails of the streams with custom settings which have not been closed by the model
+	iostream_foreach(stream_drop);
+#if IO_WRITER_THREAD==1
+	if(stages!=NULL){
+		pthread_mutex_lock(&stage_mutex);
+		writer_stop=1;
+		pthread_cond_signal(&stage_full);
+		pthread_mutex_unlock(&stage_mutex);
+		pthread_join(writer,NULL);
+		//nothing should be left if the writer has been flushed
+		stage_write(&stages[fill_stage]);
+		free(stages);
+		stages=NULL;
+		writer_stop=0;
+	}
+#endif
+#if IO_URING==1
+	ring_destroy();
+#endif
+}
+
+/** \brief Writes the given bytes, retrying on partial writes and interrupts.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int write_all(int fd,char* data,size_t len){
+	struct iovec chunk;
+	chunk.iov_base=data;
+	chunk.iov_len=len;
+	return writev_all(fd,&chunk,1);
+}
+
+/** \brief Writes the chunk of an unordered stream, the caller must hold the lock of the chunk.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int chunk_write(iostream* stream){
+	int res;
+	if(stream->chunk_len==0){
+		return IOBUF_OP_SUCCESS;
+	}
+	fflush(stream->file);
+	//a whole chunk goes in a single write, so the records are not split between the writes
+	res=write_all(fileno(stream->file),stream->chunk,stream->chunk_len);
+	stream->chunk_len=0;
+	return res;
+}
+
+/** \brief Writes the chunk of an unordered stream, if it has one.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int chunk_flush(iostream* stream){
+	int res;
+	if(stream->chunk==NULL){
+		return IOBUF_OP_SUCCESS;
+	}
+	pthread_mutex_lock(&stream->chunk_mutex);
+	res=chunk_write(stream);
+	pthread_mutex_unlock(&stream->chunk_mutex);
+	return res;
+}
+
+/** \brief Writes and frees the chunk of an unordered stream, to be called when the stream is closed.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int chunk_release(iostream* stream){
+	int res=chunk_flush(stream);
+	free(stream->chunk);
+	stream->chunk=NULL;
+	return res;
+}
+
+/** \brief Removes some settings from a stream, the change is published to the wrappers which cache the settings.
+ * \param[in,out] stream The stream.
+ * \param[in] flags The IOSTREAM_* flags to remove.
+ */
+static void stream_clear(iostream* stream,unsigned int flags){
+	__sync_fetch_and_and(&stream->flags,~flags);
+	__sync_fetch_and_add(&iostream_generation,1);
+}
+
+/** \brief Prepares a stream with custom settings, when its first record is written.
+ * The caller must have written the records of the stream which have been gathered, what is left in the FILE is written here. Then the file offset must be aligned for O_DIRECT.
+ * The settings which cannot be applied (e.g. O_DIRECT on a file system which does not support it) are removed, so the stream falls back to the normal path.
+ * \param[in,out] stream The stream.
+ */
+static void stream_open(iostream* stream){
+	int fd,flags;
+	off_t offset;
+	stream->opened=1;
+	fflush(stream->file);
+	//the sink receives the records as they have been written by the model
+	if(stream->flags&IOSTREAM_SINK){
+		stream_clear(stream,IOSTREAM_CUSTOM&~IOSTREAM_SINK);
+		return;
+	}
+	//the offsets of a compressed, segmented or columnar stream do not identify a record in a single file
+	if(stream->flags&(IOSTREAM_COMPRESS|IOSTREAM_SEGMENT|IOSTREAM_COLUMNAR)){
+		stream_clear(stream,IOSTREAM_INDEX);
+	}
+	if(stream->flags&IOSTREAM_INDEX){
+		offset=lseek(fileno(stream->file),0,SEEK_CUR);
+		if(offset<0){
+			stream_clear(stream,IOSTREAM_INDEX);
+		}else{
+			stream->offset=offset;
+			stream->written=offset;
+			stream->next_entry=offset;
+		}
+	}
+	if(stream->flags&IOSTREAM_COMPRESS){
+		stream->codec=iocompress_new(stream->level);
+		if(stream->codec==NULL){
+			stream_clear(stream,IOSTREAM_COMPRESS);
+		}
+	}
+	//the segments are opened and closed by the committer, so they are not written with O_DIRECT
+	if(stream->flags&IOSTREAM_SEGMENT){
+		stream_clear(stream,IOSTREAM_DIRECT);
+	}
+	if(!(stream->flags&IOSTREAM_DIRECT)){
+		return;
+	}
+	fd=fileno(stream->file);
+	offset=lseek(fd,0,SEEK_CUR);
+	if(offset<0 || offset%IO_DIRECT_ALIGN!=0){
+		stream_clear(stream,IOSTREAM_DIRECT);
+		return;
+	}
+	if(posix_memalign((void**)&stream->block,IO_DIRECT_ALIGN,IO_DIRECT_BLOCK)!=0){
+		stream->block=NULL;
+		stream_clear(stream,IOSTREAM_DIRECT);
+		return;
+	}
+	flags=fcntl(fd,F_GETFL);
+	if(flags<0 || fcntl(fd,F_SETFL,flags|O_DIRECT)<0){
+		free(stream->block);
+		stream->block=NULL;
+		stream_clear(stream,IOSTREAM_DIRECT);
+		return;
+	}
+	stream->block_len=0;
+}
+
+/** \brief Records that some bytes of the stream have reached the file, the index entries which point to them are written.
+ * So the index never points beyond the data in the file.
+ * \param[in,out] stream The stream.
+ * \param[in] len The bytes which have been written.
+ */
+static void stream_written(iostream* stream,size_t len){
+	unsigned int i=0;
+	stream->written+=len;
+	if(stream->pending_len==0){
+		return;
+	}
+	while(i<stream->pending_len && stream->pending[i].offset<stream->written){
+		i++;
+	}
+	if(i==0){
+		return;
+	}
+	write_all(stream->index_fd,(char*)stream->pending,i*sizeof(iostream_index_entry));
+	stream->pending_len-=i;
+	memmove(stream->pending,stream->pending+i,stream->pending_len*sizeof(iostream_index_entry));
+}
+
+/** \brief Adds an entry to the index of the stream if the record is far enough from the previous entry.
+ * \param[in,out] stream The stream.
+ * \param[in] timestamp The timestamp of the record which is going to be emitted.
+ */
+static void stream_index(iostream* stream,double timestamp){
+	iostream_index_entry* pending;
+	if(stream->offset<stream->next_entry){
+		return;
+	}
+	if(stream->pending_len==stream->pending_size){
+		pending=realloc(stream->pending,sizeof(iostream_index_entry)*(stream->pending_size*2+4));
+		if(pending==NULL){
+			return;
+		}
+		stream->pending=pending;
+		stream->pending_size=stream->pending_size*2+4;
+	}
+	stream->pending[stream->pending_len].timestamp=timestamp;
+	stream->pending[stream->pending_len].offset=stream->offset;
+	stream->pending_len++;
+	stream->next_entry=stream->offset+stream->index_every;
+}
+
+/** \brief Writes data on a stream with custom settings, the data has already been compressed if needed.
+ * For O_DIRECT streams the data is copied in the staging block, which is written each time it is full.
+ * \param[in] arg The stream.
+ * \param[in] data The data to write.
+ * \param[in] len The size of the data.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int stream_emit(void* arg,char* data,size_t len){
+	iostream* stream=(iostream*)arg;
+	int res=IOBUF_OP_SUCCESS;
+	size_t off=0,chunk;
+	stream->offset+=len;
+	if(stream->segment>=0){
+		return write_all(stream->segment_fd,data,len);
+	}
+	if(stream->block==NULL){
+		res=write_all(fileno(stream->file),data,len);
+		if(res==IOBUF_OP_SUCCESS){
+			stream_written(stream,len);
+		}
+		return res;
+	}
+	while(off<len && res==IOBUF_OP_SUCCESS){
+		chunk=len-off;
+		if(chunk>IO_DIRECT_BLOCK-stream->block_len){
+			chunk=IO_DIRECT_BLOCK-stream->block_len;
+		}
+		memcpy(stream->block+stream->block_len,data+off,chunk);
+		stream->block_len+=chunk;
+		off+=chunk;
+		if(stream->block_len==IO_DIRECT_BLOCK){
+			res=write_all(fileno(stream->file),stream->block,IO_DIRECT_BLOCK);
+			if(res==IOBUF_OP_SUCCESS){
+				stream_written(stream,IO_DIRECT_BLOCK);
+			}
+			stream->block_len=0;
+		}
+	}
+	return res;
+}
+
+/** \brief Hands the records gathered for the sink of a stream to the sink.
+ * \param[in,out] stream The stream.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int sink_submit(iostream* stream){
+	iosink_record records[IO_SINK_BATCH];
+	unsigned int i;
+	int res;
+	if(stream->sink_len==0){
+		return IOBUF_OP_SUCCESS;
+	}
+	for(i=0;i<stream->sink_len;i++){
+		records[i].timestamp=stream->sink_batch[i]->timestamp;
+		records[i].data=stream->sink_batch[i]->buffer;
+		records[i].len=stream->sink_batch[i]->buffer_elements_num*stream->sink_batch[i]->buffer_elements_size;
+	}
+	res=iosink_write(stream->sink,records,stream->sink_len);
+	for(i=0;i<stream->sink_len;i++){
+		destroy_iobuffer(stream->sink_batch[i]);
+	}
+	stream->sink_len=0;
+	return res;
+}
+
+/** \brief Writes the batches of a columnar stream, they are compressed if needed.
+ * \param[in] arg The stream.
+ * \param[in] data The encoded data.
+ * \param[in] len The size of the data.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int columnar_emit(void* arg,char* data,size_t len){
+	iostream* stream=(iostream*)arg;
+	if(stream->codec!=NULL){
+		return iocompress_add(stream->codec,data,len,stream_emit,stream);
+	}
+	return stream_emit(stream,data,len);
+}
+
+/** \brief Closes the open segment of a stream, then renames it removing the .part suffix, so it is visible as complete.
+ * \param[in,out] stream The stream.
+ * \returns ::IOBUF_OP_SUCCESS or the first error, e.g. EINVAL if a partial columnar record has been dropped.
+ */
+static int segment_close(iostream* stream){
+	char part[PATH_MAX],done[PATH_MAX];
+	int res=IOBUF_OP_SUCCESS,finish_res;
+	if(stream->segment<0){
+		return res;
+	}
+	//the last batch and the footer of a columnar stream, then the last compressed block, must end in this segment
+	if(stream->columnar!=NULL){
+		res=iocolumnar_finish(stream->columnar,columnar_emit,stream);
+	}
+	if(stream->codec!=NULL){
+		finish_res=iocompress_finish(stream->codec,stream_emit,stream);
+		if(res==IOBUF_OP_SUCCESS){
+			res=finish_res;
+		}
+	}
+	close(stream->segment_fd);
+	snprintf(part,PATH_MAX,"%s.%ld.part",stream->prefix,stream->segment);
+	snprintf(done,PATH_MAX,"%s.%ld",stream->prefix,stream->segment);
+	rename(part,done);
+	stream->segment=-1;
+	stream->segment_fd=-1;
+	return res;
+}
+
+/** \brief Opens the segment which covers the given window.
+ * \param[in,out] stream The stream.
+ * \param[in] segment The index of the window.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int segment_open(iostream* stream,long segment){
+	char part[PATH_MAX];
+	snprintf(part,PATH_MAX,"%s.%ld.part",stream->prefix,segment);
+	stream->segment_fd=open(part,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if(stream->segment_fd<0){
+		return errno;
+	}
+	stream->segment=segment;
+	return IOBUF_OP_SUCCESS;
+}
+
+/// \brief closes the open segment of the stream if the horizon has passed the end of its window.
+static void segment_expire(iostream* stream){
+	if(stream->segment>=0 && (stream->segment+1)*stream->window<=segment_horizon){
+		segment_close(stream);
+	}
+}
+
+/** \brief Writes a record on a stream with custom settings.
+ * \param[in,out] stream The stream.
+ * \param[in] buf The record, it is destroyed.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int stream_write(iostream* stream,iobuffer* buf){
+	int res,close_res=IOBUF_OP_SUCCESS;
+	long segment;
+	size_t len=buf->buffer_elements_num*buf->buffer_elements_size;
+	if(stream->sink!=NULL){
+		stream->sink_batch[stream->sink_len++]=buf;
+		if(stream->sink_len==IO_SINK_BATCH){
+			return sink_submit(stream);
+		}
+		return IOBUF_OP_SUCCESS;
+	}
+	if(stream->flags&IOSTREAM_SEGMENT){
+		//the records arrive in timestamp order, so the previous windows are complete
+		segment=(long)floor(buf->timestamp/stream->window);
+		if(segment!=stream->segment){
+			//the record goes in the new segment even if the previous one has not been completed
+			close_res=segment_close(stream);
+			res=segment_open(stream,segment);
+			if(res!=IOBUF_OP_SUCCESS){
+				destroy_iobuffer(buf);
+				return res;
+			}
+		}
+	}
+	if(stream->flags&IOSTREAM_INDEX){
+		stream_index(stream,buf->timestamp);
+	}
+	if(stream->columnar!=NULL){
+		res=iocolumnar_add(stream->columnar,buf->buffer,len,columnar_emit,stream);
+	}else if(stream->codec!=NULL){
+		res=iocompress_add(stream->codec,buf->buffer,len,stream_emit,stream);
+	}else{
+		res=stream_emit(stream,buf->buffer,len);
+	}
+	destroy_iobuffer(buf);
+	return close_res!=IOBUF_OP_SUCCESS ? close_res : res;
+}
+
+/** \brief Writes what is left of a stream with custom settings, it will be prepared again if other records are written.
+ * The last compressed block is emitted, then the aligned part of the O_DIRECT staging block is written with O_DIRECT and the unaligned tail without it.
+ * \param[in,out] stream The stream.
+ * \returns ::IOBUF_OP_SUCCESS or the first error, e.g. EINVAL if a partial columnar record has been dropped.
+ */
+static int stream_close(iostream* stream){
+	int fd,flags,res=IOBUF_OP_SUCCESS,close_res=IOBUF_OP_SUCCESS,finish_res;
+	size_t aligned;
+	if(stream->sink!=NULL){
+		close_res=sink_submit(stream);
+		finish_res=iosink_flush(stream->sink);
+		if(close_res==IOBUF_OP_SUCCESS){
+			close_res=finish_res;
+		}
+	}
+	finish_res=segment_close(stream);
+	if(close_res==IOBUF_OP_SUCCESS){
+		close_res=finish_res;
+	}
+	if(stream->columnar!=NULL){
+		finish_res=iocolumnar_finish(stream->columnar,columnar_emit,stream);
+		if(close_res==IOBUF_OP_SUCCESS){
+			close_res=finish_res;
+		}
+	}
+	if(stream->codec!=NULL){
+		finish_res=iocompress_finish(stream->codec,stream_emit,stream);
+		if(close_res==IOBUF_OP_SUCCESS){
+			close_res=finish_res;
+		}
+		iocompress_delete(stream->codec);
+		stream->codec=NULL;
+	}
+	stream->opened=0;
+	if(stream->block==NULL){
+		return close_res;
+	}
+	fd=fileno(stream->file);
+	aligned=stream->block_len-stream->block_len%IO_DIRECT_ALIGN;
+	if(aligned>0){
+		res=write_all(fd,stream->block,aligned);
+	}
+	flags=fcntl(fd,F_GETFL);
+	if(flags>=0){
+		fcntl(fd,F_SETFL,flags&~O_DIRECT);
+	}
+	if(res==IOBUF_OP_SUCCESS && stream->block_len>aligned){
+		res=write_all(fd,stream->block+aligned,stream->block_len-aligned);
+	}
+	if(res==IOBUF_OP_SUCCESS){
+		stream_written(stream,stream->block_len);
+	}
+	free(stream->block);
+	stream->block=NULL;
+	stream->block_len=0;
+	return close_res!=IOBUF_OP_SUCCESS ? close_res : res;
+}
+
+int iowriter_direct(FILE* file){
+	iostream* stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	//the switch is done by the committer, when it writes the first record of the stream
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_DIRECT);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+int iowriter_segment(FILE* file,const char* prefix,double window){
+	iostream* stream;
+	if(prefix==NULL || !(window>0)){
+		return EINVAL;
+	}
+	stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	if(stream->prefix==NULL){
+		stream->prefix=strdup(prefix);
+		if(stream->prefix==NULL){
+			return ENOMEM;
+		}
+	}
+	stream->window=window;
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_SEGMENT);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+/// \brief hands the gathered records to the sink of a stream, so a live consumer sees every record older than the horizon.
+static void sink_horizon(iostream* stream){
+	if(stream->sink!=NULL && stream->sink_len>0){
+		sink_submit(stream);
+		iosink_flush(stream->sink);
+	}
+}
+
+/// \brief closes the expired segment and flushes the sink of a stream which does not have its own merge heap, the other ones are handled by ::iowriter_stream_horizon.
+static void stream_expire_shared(iostream* stream){
+	if(stream->merger==NULL){
+		segment_expire(stream);
+		sink_horizon(stream);
+	}
+}
+
+void iowriter_horizon(double horizon){
+	segment_horizon=horizon;
+	iostream_foreach(stream_expire_shared);
+}
+
+void iowriter_stream_horizon(iostream* stream,double horizon){
+	if(stream->segment>=0 && (stream->segment+1)*stream->window<=horizon){
+		segment_close(stream);
+	}
+	sink_horizon(stream);
+}
+
+/** \brief Writes what is left of a stream and releases its settings.
+ * \param[in,out] stream The stream.
+ * \returns ::IOBUF_OP_SUCCESS or the first error.
+ */
+static int stream_release(iostream* stream){
+	int res=chunk_release(stream);
+	int close_res=stream_close(stream);
+	if(res==IOBUF_OP_SUCCESS){
+		res=close_res;
+	}
+	iocolumnar_delete(stream->columnar);
+	stream->columnar=NULL;
+	iosink_close(stream->sink);
+	stream->sink=NULL;
+	free(stream->sink_batch);
+	stream->sink_batch=NULL;
+	free(stream->prefix);
+	stream->prefix=NULL;
+	if(stream->index_fd>=0){
+		close(stream->index_fd);
+		stream->index_fd=-1;
+	}
+	free(stream->pending);
+	stream->pending=NULL;
+	stream->pending_len=0;
+	stream->pending_size=0;
+	return res;
+}
+
+/// \brief releases a stream at the end of the simulation, when there is nobody left to report an error to.
+static void stream_drop(iostream* stream){
+	stream_release(stream);
+}
+
+int iowriter_index(FILE* file,const char* path,size_t every){
+	iostream* stream;
+	int fd;
+	if(path==NULL){
+		return EINVAL;
+	}
+	stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	if(stream->index_fd<0){
+		fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if(fd<0){
+			return errno;
+		}
+		stream->index_fd=fd;
+	}
+	stream->index_every=every;
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_INDEX);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+int iowriter_compress(FILE* file,int level){
+	iostream* stream;
+#if IO_COMPRESSION==0
+	(void)file;
+	(void)level;
+	return ENOSYS;
+#endif
+	stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	stream->level=level;
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_COMPRESS);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+int iowriter_sink(FILE* file,iosink* sink){
+	iostream* stream;
+	if(sink==NULL){
+		return EINVAL;
+	}
+	stream=iostream_add(file);
+	if(stream==NULL){
+		return ENOMEM;
+	}
+	if(stream->sink!=NULL){
+		return EEXIST;
+	}
+	stream->sink_batch=malloc(sizeof(iobuffer*)*IO_SINK_BATCH);
+	if(stream->sink_batch==NULL){
+		return ENOMEM;
+	}
+	stream->sink_len=0;
+	stream->sink=sink;
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_SINK);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+/// \brief receives the writes executed through the FILE of a sink, which happen only with the ::IO_POLICY_PASSTHROUGH policy.
+static ssize_t sink_cookie_write(void* cookie,const char* data,size_t len){
+	iosink_record record;
+	record.timestamp=-1;
+	record.data=data;
+	record.len=len;
+	if(iosink_write((iosink*)cookie,&record,1)!=0){
+		return -1;
+	}
+	return len;
+}
+
+/// \brief closes the FILE of a sink, the sink itself is closed with the settings of the stream.
+static int sink_cookie_close(void* cookie){
+	(void)cookie;
+	return 0;
+}
+
+FILE* iowriter_sink_open(iosink* sink){
+	cookie_io_functions_t functions={NULL,sink_cookie_write,NULL,sink_cookie_close};
+	FILE* file;
+	int res;
+	if(sink==NULL){
+		errno=EINVAL;
+		return NULL;
+	}
+	file=fopencookie(sink,"w",functions);
+	if(file==NULL){
+		return NULL;
+	}
+	//the records are handed to the sink as soon as they are written through the FILE
+	setvbuf(file,NULL,_IONBF,0);
+	res=iowriter_sink(file,sink);
+	if(res!=IOBUF_OP_SUCCESS){
+		__real_fclose(file);
+		errno=res;
+		return NULL;
+	}
+	return file;
+}
+
+int iowriter_columnar(FILE* file,size_t record_size,const iocolumn* columns,unsigned int n){
+	iostream* stream;
+	iocolumnar* columnar=iocolumnar_new(record_size,columns,n);
+	if(columnar==NULL){
+		return EINVAL;
+	}
+	stream=iostream_add(file);
+	if(stream==NULL){
+		iocolumnar_delete(columnar);
+		return ENOMEM;
+	}
+	if(stream->columnar!=NULL){
+		iocolumnar_delete(columnar);
+		return EEXIST;
+	}
+	stream->columnar=columnar;
+	__sync_fetch_and_or(&stream->flags,IOSTREAM_COLUMNAR);
+	__sync_fetch_and_add(&iostream_generation,1);
+	return IOBUF_OP_SUCCESS;
+}
+
+/** \brief Executes a positioned record or an fclose request through the FILE, the records gathered before it must have been written.
+ * \param[in,out] stream The registry entry of the stream, or NULL.
+ * \param[in] buf The record, it is destroyed.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+static int stream_execute(iostream* stream,iobuffer* buf){
+	int res=IOBUF_OP_SUCCESS,write_res;
+	if(buf->operation==IOBUF_FCLOSE && !iopool_release(buf->file)){
+		//the pooled file is still open for other fopens
+		destroy_iobuffer(buf);
+		return IOBUF_OP_SUCCESS;
+	}
+	if(stream!=NULL){
+		//the unordered records collected before it must reach the file first
+		res=chunk_flush(stream);
+		if(buf->operation==IOBUF_FCLOSE){
+			write_res=stream_release(stream);
+		}else{
+			write_res=stream_close(stream);
+		}
+		if(res==IOBUF_OP_SUCCESS){
+			res=write_res;
+		}
+	}
+	write_res=iobuffer_write(buf);
+	if(res==IOBUF_OP_SUCCESS){
+		res=write_res;
+	}
+	if(stream!=NULL && buf->operation==IOBUF_FCLOSE){
+		iostream_remove(buf->file);
+	}
+	destroy_iobuffer(buf);
+	return res;
+}
+
+int iowriter_unordered_flush(){
+	unsigned int i;
+	int res=IOBUF_OP_SUCCESS,chunk_res;
+	iostream* stream;
+	for(i=0;i<iostream_slots();i++){
+		stream=iostream_slot(i);
+		if(stream==NULL){
+			continue;
+		}
+		chunk_res=chunk_flush(stream);
+		if(res==IOBUF_OP_SUCCESS){
+			res=chunk_res;
+		}
+	}
+	return res;
+}
+
+int iowriter_unordered_write(iobuffer* buf){
+	int res=IOBUF_OP_SUCCESS;
+	size_t len=buf->buffer_elements_num*buf->buffer_elements_size;
+	iostream* stream=iostream_get(buf->file);
+	if(buf->operation==IOBUF_FWRITE && buf->file_position>=0){
+		if(stream!=NULL){
+			res=chunk_flush(stream);
+		}
+		if(res==IOBUF_OP_SUCCESS && len>0){
+			struct iovec chunk={buf->buffer,len};
+			fflush(buf->file);
+			res=pwritev_all(fileno(buf->file),&chunk,1,buf->file_position);
+		}
+		destroy_iobuffer(buf);
+		return res;
+	}
+	if(buf->operation==IOBUF_FCLOSE){
+		if(!iopool_release(buf->file)){
+			//the pooled file is still open for other fopens, which keep filling the chunk
+			destroy_iobuffer(buf);
+			return res;
+		}
+		if(stream!=NULL){
+			res=chunk_release(stream);
+		}
+		if(res==IOBUF_OP_SUCCESS){
+			res=iobuffer_write(buf);
+		}
+		if(buf->operation==IOBUF_FCLOSE){
+			iostream_remove(buf->file);
+		}
+		destroy_iobuffer(buf);
+		return res;
+	}
+	if(len==0){
+		destroy_iobuffer(buf);
+		return res;
+	}
+	if(stream==NULL){
+		//without an entry in the registry there is no chunk, the record is written by itself
+		fflush(buf->file);
+		res=write_all(fileno(buf->file),buf->buffer,len);
+		destroy_iobuffer(buf);
+		return res;
+	}
+	pthread_mutex_lock(&stream->chunk_mutex);
+	if(stream->chunk_len+len>IO_UNORDERED_CHUNK){
+		res=chunk_write(stream);
+	}
+	if(stream->chunk==NULL && len<IO_UNORDERED_CHUNK){
+		stream->chunk=malloc(IO_UNORDERED_CHUNK);
+	}
+	if(len>=IO_UNORDERED_CHUNK || stream->chunk==NULL){
+		if(res==IOBUF_OP_SUCCESS){
+			fflush(buf->file);
+			res=write_all(fileno(buf->file),buf->buffer,len);
+		}
+	}else{
+		memcpy(stream->chunk+stream->chunk_len,buf->buffer,len);
+		stream->chunk_len+=len;
+	}
+	pthread_mutex_unlock(&stream->chunk_mutex);
+	destroy_iobuffer(buf);
+	return res;
+}
+
+int iowriter_local_flush(iowriter_local* local){
+	int i,res=positioned_flush(&local->positioned);
+	if(local->len==0){
+		return res;
+	}
+	res=writev_all(fileno(local->file),local->iov,local->len);
+	for(i=0;i<local->len;i++){
+		destroy_iobuffer(local->bufs[i]);
+	}
+	local->file=NULL;
+	local->len=0;
+	return res;
+}
+
+int iowriter_local_write(iowriter_local* local,iostream* stream,iobuffer* buf){
+	int res;
+	if(buf->operation==IOBUF_FWRITE && buf->file_position>=0 && (stream==NULL || !(stream->flags&IOSTREAM_CUSTOM))){
+		//the sequential records gathered before must reach the file first
+		if(local->len>0){
+			res=iowriter_local_flush(local);
+			if(res!=IOBUF_OP_SUCCESS){
+				destroy_iobuffer(buf);
+				return res;
+			}
+		}
+		return positioned_add(&local->positioned,buf);
+	}
+	if(local->positioned.len>0){
+		res=positioned_flush(&local->positioned);
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+	}
+	if(buf->operation==IOBUF_FCLOSE || buf->file_position>=0){
+		res=iowriter_local_flush(local);
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+		return stream_execute(stream,buf);
+	}
+	if(buf->buffer_elements_num==0 || buf->buffer_elements_size==0){
+		destroy_iobuffer(buf);
+		return IOBUF_OP_SUCCESS;
+	}
+	if(stream!=NULL && (stream->flags&IOSTREAM_CUSTOM)){
+		res=iowriter_local_flush(local);
+		if(!stream->opened){
+			stream_open(stream);
+		}
+		if(stream->flags&IOSTREAM_CUSTOM){
+			return stream_write(stream,buf);
+		}
+	}
+	if(local->file!=buf->file || local->len==IO_LOCAL_IOV){
+		res=iowriter_local_flush(local);
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+		fflush(buf->file);
+		local->file=buf->file;
+	}
+	local->iov[local->len].iov_base=buf->buffer;
+	local->iov[local->len].iov_len=buf->buffer_elements_num*buf->buffer_elements_size;
+	local->bufs[local->len]=buf;
+	local->len++;
+	return IOBUF_OP_SUCCESS;
+}
+
+int iowriter_write(iobuffer* buf){
+	int res;
+	iostream* stream;
+	if(buf==NULL){
+		return ENOENT;
+	}
+	stream=iostream_get(buf->file);
+	if(buf->operation==IOBUF_FWRITE && buf->file_position>=0 && (stream==NULL || !(stream->flags&IOSTREAM_CUSTOM))){
+		//a run of positioned records starts after everything gathered before it has been written
+		if(positioned_batch.len==0){
+			res=iowriter_flush();
+			if(res!=IOBUF_OP_SUCCESS){
+				destroy_iobuffer(buf);
+				return res;
+			}
+		}
+		res=positioned_add(&positioned_batch,buf);
+#if IO_FLUSH_POLICY==IO_FLUSH_RECORD
+		if(res==IOBUF_OP_SUCCESS){
+			res=positioned_flush(&positioned_batch);
+		}
+#endif
+		return res;
+	}
+	if(positioned_batch.len>0){
+		res=positioned_flush(&positioned_batch);
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+	}
+	//fclose requests and the positioned records of the streams with custom settings are executed through the FILE, after everything gathered before them
+	if(buf->operation==IOBUF_FCLOSE || buf->file_position>=0){
+		res=iowriter_flush();
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+		return stream_execute(stream,buf);
+	}
+	if(stream!=NULL && (stream->flags&IOSTREAM_CUSTOM) && buf->buffer_elements_num>0 && buf->buffer_elements_size>0){
+		if(!stream->opened){
+			//the records of the stream gathered so far must be written first
+			iowriter_flush();
+			stream_open(stream);
+		}
+		if(stream->flags&IOSTREAM_CUSTOM){
+			return stream_write(stream,buf);
+		}
+	}
+	if(buf->buffer_elements_num==0 || buf->buffer_elements_size==0){
+		destroy_iobuffer(buf);
+		return IOBUF_OP_SUCCESS;
+	}
+	if(batch_file!=buf->file || batch_len==IOV_MAX){
+		res=batch_submit();
+		if(res!=IOBUF_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			return res;
+		}
+		//the writev bypasses the FILE buffer, so what is still there must be written first
+		fflush(buf->file);
+		batch_file=buf->file;
+	}
+	batch_iov[batch_len].iov_base=buf->buffer;
+	batch_iov[batch_len].iov_len=buf->buffer_elements_num*buf->buffer_elements_size;
+	batch_bufs[batch_len]=buf;
+	batch_bytes+=batch_iov[batch_len].iov_len;
+	batch_len++;
+#if IO_FLUSH_POLICY==IO_FLUSH_RECORD
+	return batch_submit();
+#elif IO_FLUSH_POLICY==IO_FLUSH_SIZE
+	if(batch_bytes>=IO_WRITER_FLUSH_SIZE){
+		return batch_submit();
+	}
+#endif
+	return IOBUF_OP_SUCCESS;
+}
@@ -0,0 +1,225 @@
+/** \file iowriter.h
+ * The writer stage of the reversible I/O: the committed iobuffers are gathered and written with a single system call for each file.
+ */
+
+#ifndef IOWRITER_H_INCLUDED
+#define IOWRITER_H_INCLUDED
+
+#include "iobuffer.h"
+#include "iostream.h"
+#include "iocolumnar.h"
+#include "iosink.h"
+
+#include <sys/uio.h>
+
+///The gathered records are written as soon as they are received.
+#define IO_FLUSH_RECORD 0
+///The gathered records are written at the end of each execution of the committed operations.
+#define IO_FLUSH_BATCH 1
+///The gathered records are written when they hold at least ::IO_WRITER_FLUSH_SIZE bytes.
+#define IO_FLUSH_SIZE 2
+///The gathered records are written only when they cannot be gathered anymore or at the end of the simulation.
+#define IO_FLUSH_END 3
+
+#ifndef IO_FLUSH_POLICY
+///When the gathered records are written, one of IO_FLUSH_RECORD, IO_FLUSH_BATCH, IO_FLUSH_SIZE or IO_FLUSH_END.
+#define IO_FLUSH_POLICY IO_FLUSH_BATCH
+#endif
+
+#ifndef IO_WRITER_FLUSH_SIZE
+///Threshold (in bytes) used by the ::IO_FLUSH_SIZE policy.
+#define IO_WRITER_FLUSH_SIZE (64UL<<10)
+#endif
+
+#ifndef IO_URING
+///If set to 1 the gathered records are submitted to an io_uring instead of being written with writev.
+#define IO_URING 0
+#endif
+
+#ifndef IO_URING_BUFS
+///Number of registered staging buffers used by the io_uring backend.
+#define IO_URING_BUFS 16
+#endif
+
+#ifndef IO_URING_BUF_SIZE
+///Size (in bytes) of each registered staging buffer.
+#define IO_URING_BUF_SIZE (64UL<<10)
+#endif
+
+#ifndef IO_WRITER_THREAD
+///If set to 1 the gathered records are written by a dedicated thread while the committer fills the next stage, the io_uring backend is not used in this case.
+#define IO_WRITER_THREAD 0
+#endif
+
+#ifndef IO_WRITER_SWAP_SIZE
+///The stage filled by the committer is handed to the writer thread when it holds at least this many bytes.
+#define IO_WRITER_SWAP_SIZE (1UL<<20)
+#endif
+
+#ifndef IO_WRITER_STAGE_RECORDS
+///Maximum number of records held by a stage.
+#define IO_WRITER_STAGE_RECORDS 8192
+#endif
+
+#ifndef IO_POSITIONED_BATCH
+///Maximum number of positioned records which are sorted and coalesced together.
+#define IO_POSITIONED_BATCH 64
+#endif
+
+///A set of positioned records of the same file, written sorted by offset with pwritev.
+typedef struct _iowriter_positioned{
+	FILE* file; ///< The file of the gathered records.
+	int len; ///< The number of gathered records.
+	iobuffer* bufs[IO_POSITIONED_BATCH]; ///< The records, in timestamp order.
+} iowriter_positioned;
+
+#ifndef IO_LOCAL_IOV
+///Maximum number of records gathered by an ::iowriter_local.
+#define IO_LOCAL_IOV 64
+#endif
+
+#ifndef IO_UNORDERED_CHUNK
+///Size (in bytes) of the chunk in which the records of each unordered stream are copied.
+#define IO_UNORDERED_CHUNK (64UL<<10)
+#endif
+
+///A small set of gathered records owned by the caller, so the records of different streams can be written by different threads at the same time.
+typedef struct _iowriter_local{
+	FILE* file; ///< The file of the gathered records.
+	int len; ///< The number of gathered records.
+	struct iovec iov[IO_LOCAL_IOV]; ///< The chunks to be written by writev.
+	iobuffer* bufs[IO_LOCAL_IOV]; ///< The iobuffers which own the chunks.
+	iowriter_positioned positioned; ///< The gathered positioned records.
+} iowriter_local;
+
+/** \brief Hands an iobuffer over to the writer.
+ * Consecutive records for the same file are gathered and written with a single writev, according to ::IO_FLUSH_POLICY.
+ * Consecutive records with a file position are gathered as well, then sorted by offset and coalesced in pwritev calls.
+ * The fclose requests and the positioned records of the streams with custom settings are executed immediately, after the gathered records.
+ * The iobuffer is owned by the writer from now on, it will be destroyed once written.
+ * Only the owner of the commit role can call it.
+ * \param[in] buf The iobuffer to write.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_write(iobuffer* buf);
+
+/** \brief Hands an iobuffer over to a set of gathered records owned by the caller.
+ * It does not use the shared state of the writer, so it can be called at the same time by different threads as long as they write different streams.
+ * The records are always written synchronously with writev, the io_uring backend and the writer thread are not used.
+ * \param[in,out] local The gathered records, it must be zeroed before its first use.
+ * \param[in,out] stream The registry entry of the stream of the record, or NULL.
+ * \param[in] buf The iobuffer to write, it is owned by the writer from now on.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_local_write(iowriter_local* local,iostream* stream,iobuffer* buf);
+
+/** \brief Writes the records gathered in a set owned by the caller.
+ * \param[in,out] local The gathered records.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_local_flush(iowriter_local* local);
+
+/** \brief Copies a record of an ::IO_POLICY_UNORDERED stream, or of a stream written by a single LP, in the chunk of the stream.
+ * The chunk is written when the next record does not fit, a record is never split between two writes unless it is larger than the chunk.
+ * Positioned records and fclose requests are executed through the FILE, after the chunk, which is released by the fclose.
+ * It can be called by any thread at any time, the custom settings of the stream are ignored.
+ * \param[in] buf The iobuffer to write, it is destroyed.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_unordered_write(iobuffer* buf);
+
+/** \brief Writes the chunks of every stream, to be called at the end of the run.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_unordered_flush();
+
+/** \brief Notifies the writer that an execution of the committed operations has ended.
+ * With the ::IO_FLUSH_BATCH policy the gathered records are written.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_end_batch();
+
+/** \brief Writes all the gathered records, regardless of the policy, and waits until they have been written.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_flush();
+
+/** \brief Asks to write the committed records of a stream with O_DIRECT.
+ * The committer switches the stream when it writes its first record, if the offset of the file is aligned to ::IO_DIRECT_ALIGN and the file system supports it, otherwise the stream is written normally.
+ * The records are gathered in blocks of ::IO_DIRECT_BLOCK bytes, the unaligned tail is written when the stream is closed or at the end of the simulation.
+ * \param[in] file The stream.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_direct(FILE* file);
+
+/** \brief Asks to compress the committed records of a stream.
+ * The records are gathered in blocks of ::IO_COMPRESS_BLOCK bytes and each block is written as a gzip member, so the blocks can be decompressed independently and the file can be read with gzip.
+ * It can be combined with ::iowriter_direct.
+ * \param[in] file The stream.
+ * \param[in] level The zlib compression level (0-9).
+ * \returns ::IOBUF_OP_SUCCESS or an error code (ENOSYS if ::IO_COMPRESSION is not set).
+ */
+int iowriter_compress(FILE* file,int level);
+
+/** \brief Asks to split the committed records of a stream in segment files by simulated time window.
+ * The records with timestamp in [k*window,(k+1)*window) are written in <prefix>.<k>.part, which is renamed <prefix>.<k> once the horizon passes the end of the window.
+ * The stream itself does not receive any record, segmented streams are not written with O_DIRECT.
+ * \param[in] file The stream.
+ * \param[in] prefix The path prefix of the segment files.
+ * \param[in] window The simulated time covered by each segment.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_segment(FILE* file,const char* prefix,double window);
+
+/** \brief Asks to write a sidecar index of a stream.
+ * The index is a sequence of ::iostream_index_entry, one for the first record after every `every` bytes of output, so a reader can binary search the offset of a simulated time.
+ * An entry is written only after the data it points to has been written. Compressed and segmented streams cannot be indexed.
+ * \param[in] file The stream.
+ * \param[in] path The path of the index file.
+ * \param[in] every The minimum distance (in bytes) between two entries.
+ * \returns ::IOBUF_OP_SUCCESS or an error code.
+ */
+int iowriter_index(FILE* file,const char* path,size_t every);
+
+/** \brief Asks to write the committed records of a stream in columns.
+ * The stream must receive only records of record_size bytes, they are gathered in batches of ::IO_COLUMNAR_ROWS records and each batch is written as one encoded block per column, followed by a footer when the stream is closed (see iocolumnar.h).
+ * It can be combined with ::iowriter_compress, ::iowriter_segment and ::iowriter_direct; the LPs do not have a virtual position on the stream.
+ * \param[in] file The stream.
+ * \param[in] record_size The size of the records.
+ * \param[in] columns The columns of the records.
+ * \param[in] n The number of columns.
+ * \returns ::IOBUF_OP_SUCCESS or an error code (EINVAL if the columns do not fit in the record, EEXIST if the stream is already columnar).
+ */
+int iowriter_columnar(FILE* file,size_t record_size,const iocolumn* columns,unsigned int n);
+
+/** \brief Asks to hand the committed records of a stream to a sink instead of writing them on the stream.
+ * The records are handed in timestamp order, in groups of at most ::IO_SINK_BATCH, and the sink is flushed each time the horizon passes them; it is closed with the stream.
+ * The other custom settings of the stream are ignored.
+ * \param[in] file The stream.
+ * \param[in] sink The sink, it is owned by the writer from now on.
+ * \returns ::IOBUF_OP_SUCCESS or an error code (EEXIST if the stream already has a sink).
+ */
+int iowriter_sink(FILE* file,iosink* sink);
+
+/** \brief Opens a stream whose committed records are handed to a sink, see ::iowriter_sink.
+ * \param[in] sink The sink, it is owned by the writer from now on if the stream can be opened.
+ * \returns The stream, or NULL with errno set on error.
+ */
+FILE* iowriter_sink_open(iosink* sink);
+
+/** \brief Notifies the writer that every record older than the horizon has been written, the segments whose window has ended are completed.
+ * The streams with their own merge heap are skipped, see ::iowriter_stream_horizon.
+ * \param[in] horizon The horizon.
+ */
+void iowriter_horizon(double horizon);
+
+/** \brief Notifies the writer that every record of the given stream older than the horizon has been written.
+ * \param[in,out] stream The stream.
+ * \param[in] horizon The horizon.
+ */
+void iowriter_stream_horizon(iostream* stream,double horizon);
+
+///\brief Releases the resources of the writer, to be called after ::iowriter_flush.
+void iowriter_destroy();
+
+#endif // IOWRITER_H_INCLUDED
@@ -22,6 +22,7 @@ int nblist_init(nblist* list){
 		list->head->type=NBLIST_DUMMY;
 		list->head->key=0;
 		list->epoch=0;
+		list->bytes=0;
 	}
 	return NBLIST_OP_SUCCESS;
 }
@@ -63,30 +64,45 @@ void nblist_clean(nblist* list,void (*dealloc)(void*)){
 }
 
 void* nblist_pop(nblist* list){
-	if(list==NULL || list->head==NULL || list->head == list->tail){
+	if(list==NULL || list->head==NULL){
 		return NULL;
 	}
-	nblist_elem* elem=NULL;
-	//we skip the dummy nodes
-	int found_valid_elem=0;
-	while(!found_valid_elem && list->head != list->tail){
-		elem=list->head;
-		//we update the list;
-		list->head=elem->next;
-		if(elem->type!=NBLIST_DUMMY){
-			found_valid_elem=1;
-		}
+	//the head has already been consumed (or it is a dummy), so we start from the next one skipping the dummy nodes
+	nblist_elem* elem=list->head->next;
+	while(elem!=NULL && elem->type==NBLIST_DUMMY){
+		list->head=elem;
+		elem=elem->next;
+	}
+	if(elem==NULL){
+		return NULL;
 	}
-	return elem->content;
+	//the content is given to the caller, the element becomes the new head and it will be freed by nblist_clean
+	void* content=elem->content;
+	elem->content=NULL;
+	list->head=elem;
+	return content;
+}
+
+void nblist_append(nblist* list,nblist_elem* elem){
+	elem->next=NULL;
+	//the element must be complete before the consumer can reach it
+	__sync_synchronize();
+	list->tail->next=elem;
+	list->tail=elem;
 }
 
 void nblist_merge(nblist *dest,nblist *source){
-	if(dest==NULL || dest->tail==NULL || source== NULL){
+	if(dest==NULL || dest->tail==NULL || source== NULL || source->head==NULL){
 		return;
 	}
+	//the source elements must be complete before the consumer can reach them
+	__sync_synchronize();
 	dest->tail->next=source->head;
 	dest->tail=source->tail;
-	nblist_init(source);
+	//the elements now belong to dest, so the source is simply detached from them
+	source->head=NULL;
+	source->tail=NULL;
+	source->old=NULL;
 }
 
 void nblist_destroy(nblist* list,void (*dealloc)(void*)){
@@ -115,15 +131,11 @@ nblist_elem* nblist_peek(nblist* list){
 	if(list==NULL || list->head==NULL){
 		return NULL;
 	}
-	nblist_elem* elem=list->head;
-	while(elem->next!=NULL && elem->type==NBLIST_DUMMY){
+	nblist_elem* elem=list->head->next;
+	while(elem!=NULL && elem->type==NBLIST_DUMMY){
 		elem=elem->next;
 	}
-	if(elem->type!=NBLIST_DUMMY){
-		return elem;
-	}else{
-		return NULL;
-	}
+	return elem;
 }
 void nblist_print(nblist* list){
 	nblist_elem* elem=list->old;
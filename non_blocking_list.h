@@ -5,6 +5,8 @@
 #ifndef NON_BLOCKING_LIST_H_INCLUDED
 #define NON_BLOCKING_LIST_H_INCLUDED
 
+#include <stddef.h>
+
 #define NBLIST_OP_SUCCESS 0
 
 typedef enum _nblist_elem_type{
@@ -26,6 +28,7 @@ typedef struct _nblist{
 	nblist_elem* tail; ///< The last element in the list.
 	nblist_elem* old; ///< The first element that can be removed.
 	unsigned int epoch; ///< The epoch of the last operation on the list
+	size_t bytes; ///< The amount of payload bytes added to the list, maintained by the producer.
 } nblist;
 
 /** \brief Initializes the non blocking list.
@@ -46,16 +49,24 @@ int nblist_add(nblist* list, void* content,double key,nblist_elem_type type);
  */
 void nblist_clean(nblist* list,void (*dealloc)(void*));
 
-/** \brief returns the first nblist element removing it from the list.
+/** \brief returns the content of the first valid nblist element removing it from the list.
+ * The head of the list is always an element already consumed (or a dummy), so the tail can be popped as well.
+ * The content is handed over to the caller, it will not be deallocated by nblist_clean.
  * \param[in] list The list where the first element must be removed.
- * \returns NULL on error or the first element in the list.
+ * \returns NULL on error or if the list is empty, otherwise the content of the first element in the list.
  */
 void* nblist_pop(nblist* list);
 
+/** \brief Appends an element which has been detached from another list, without allocating a new one.
+ * \param[in,out] list The list where the element must be added.
+ * \param[in] elem The element.
+ */
+void nblist_append(nblist* list,nblist_elem* elem);
+
 /** \brief merges two nblists.
  * In detail the last element of the dset nblist will be connected to the first element to the source nblist.
  * Then the tail of the dest nblist will be the tail of the source nblist.
- * Finally the source nblist will be reinitialized.
+ * Finally the source nblist will be left empty (as if it was never initialized), an uninitialized source is ignored.
  * This method requires locking.
  */
 void nblist_merge(nblist *dest,nblist *source);
@@ -76,7 +87,7 @@ void nblist_set_epoch(nblist* list,unsigned int epoch);
  * \param[in] list The list to print
  */
 void nblist_print(nblist* list);
-/** \brief get the first valid element (skipping dummies) without advancing the head of the list, the list tail is not excluded.
+/** \brief get the first valid element (skipping dummies and the already consumed head) without advancing the head of the list, the list tail is not excluded.
  * \param[in] list The list in where we wish to peek.
  * \returns The first valid element NULL otherwise.
  */
@@ -4,48 +4,456 @@
 #include "iobuffer.h"
 #include "wrappers.h"
 #include "io_heap.h"
+#include "iowriter.h"
 #include "core.h"
 #include "list.h"
 #include "dymelor.h"
 #include "events.h"
+#include "iomap.h"
+#include "iopos.h"
+#include "iopool.h"
+#include "iometrics.h"
 
 #include "reversibleio.h"
 
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#if IO_COMMITTER_THREAD==1
+#include <pthread.h>
+#endif
+
 ///We have one heap for the unseekable
 io_heap *io_h;
 double* per_lp_horizon;
+///Set to 1 by the thread which is currently executing the collected operations, only the owner of this role can access io_h.
+static volatile int io_commit_role=0;
+///Bytes which have been collected but not written yet.
+static volatile unsigned long io_pending_bytes=0;
+///Monotonic time (in ns) after which the collected operations should be executed.
+static volatile unsigned long long io_commit_deadline=0;
+///Current interval (in ns) between two executions, adapted according to their cost.
+static unsigned long long io_commit_interval=IO_COMMIT_LATENCY_MS*1000000ULL;
+///Monotonic time (in ns) before which no execution is attempted, since the last one found nothing below the horizon.
+static volatile unsigned long long io_commit_retry=0;
+///Moving average of the cost (in ns) of an execution.
+static double io_commit_cost=0;
+///Set to 1 once a stream can bypass the heaps, until then the windows are collected without looking at their records.
+static volatile int io_bypass=0;
+
+///The operations are executed in timestamp order by the heaps.
+#define COLLECT_ORDERED 0
+///The writes are executed right away by the collecting thread.
+#define COLLECT_UNORDERED 1
+///The stream is written only by the collected LP, so every operation is executed right away, in the LP order.
+#define COLLECT_PRIVATE 2
+
+#if IO_ORDER_PER_FILE==1
+///The merge heap of a single file, it is executed independently from the other files.
+struct _io_merger{
+	io_heap* heap; ///< The heap which orders the records of the file.
+	nblist* lists; ///< The collected records of the file, one list per LP.
+	volatile int draining; ///< Set to 1 by the thread which is executing the records of the file.
+};
+typedef struct _io_merger io_merger;
+///Serializes the creation of the merge heaps.
+static volatile int io_merger_lock=0;
+#endif
+
+/// \brief returns the value of a coarse monotonic clock in ns, which is cheap enough to be read after each event.
+static unsigned long long reversibleio_now(){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_COARSE,&t);
+	return t.tv_sec*1000000000ULL+t.tv_nsec;
+}
+
+/** \brief Adapts the interval between two executions to their measured cost and sets the next deadline.
+ * The interval is chosen so that the executions take about ::IO_COMMIT_DUTY percent of the wall clock time, within [::IO_COMMIT_MIN_MS,::IO_COMMIT_LATENCY_MS].
+ * The caller must own the commit role.
+ * \param[in] start When the execution started.
+ * \param[in] end When the execution ended.
+ */
+static void reversibleio_tune(unsigned long long start,unsigned long long end){
+	double interval;
+	io_commit_cost=0.75*io_commit_cost+0.25*(end-start);
+	interval=io_commit_cost*100/IO_COMMIT_DUTY;
+	if(interval<IO_COMMIT_MIN_MS*1000000.0){
+		interval=IO_COMMIT_MIN_MS*1000000.0;
+	}else if(interval>IO_COMMIT_LATENCY_MS*1000000.0){
+		interval=IO_COMMIT_LATENCY_MS*1000000.0;
+	}
+	io_commit_interval=interval;
+	io_commit_deadline=end+io_commit_interval;
+	io_commit_retry=0;
+}
+
+/** \brief Postpones the next execution after an attempt which found nothing below the horizon.
+ * The interval is doubled up to ::IO_COMMIT_LATENCY_MS and, until it expires, not even ::IO_COMMIT_BYTES triggers a new attempt.
+ * The caller must own the commit role.
+ * \param[in] now When the attempt ended.
+ */
+static void reversibleio_backoff(unsigned long long now){
+	io_commit_interval*=2;
+	if(io_commit_interval>IO_COMMIT_LATENCY_MS*1000000ULL){
+		io_commit_interval=IO_COMMIT_LATENCY_MS*1000000ULL;
+	}
+	io_commit_deadline=now+io_commit_interval;
+	io_commit_retry=io_commit_deadline;
+}
+
+#if IO_COMMITTER_THREAD==1
+///defined in core.c
+extern void set_affinity(unsigned int tid);
+///The thread which owns io_h and executes the collected operations.
+static pthread_t io_committer;
+///Set to ask the committer to terminate.
+static volatile int io_committer_stop=0;
+
+/** \brief Main loop of the committer thread.
+ * It continuously executes the operations which have been collected by the worker threads, until the simulation ends.
+ */
+static void* reversibleio_committer(void* args){
+	(void)args;
+	//the committer is pinned on the first core which is not used by the worker threads, if any
+	if(n_cores<N_CPU){
+		set_affinity(n_cores);
+	}
+	while(!io_committer_stop){
+		if(reversibleio_execute()==0){
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+#endif
 
 void reversibleio_init(){
 	unsigned i;
 	//we create the heap
 	per_lp_horizon=rsalloc(sizeof(double)*n_prc_tot);
-	memset(per_lp_horizon,-1,sizeof(double)*n_prc_tot);
 	io_h=io_heap_new(MIN_HEAP,n_prc_tot);
+	io_commit_deadline=reversibleio_now()+io_commit_interval;
 	//we initialize the windows in each LP.
 	for(i=0;i<n_prc_tot;i++){
+		//nothing has been collected yet
+		per_lp_horizon[i]=0;
 		nblist_init(&LPS[i]->io_forward_window);
 		//nblist_init(LPS[i]->io_reverse_window);
+		LPS[i]->io_collect_cursor=NULL;
+		LPS[i]->io_positions=NULL;
+		LPS[i]->io_metrics=NULL;
 		//during the initialization we populate the heap with the forward windows
 		io_heap_add(io_h,&LPS[i]->io_forward_window);
 	}
+#if IO_COMMITTER_THREAD==1
+	if(pthread_create(&io_committer,NULL,reversibleio_committer,NULL)!=0){
+		//the printf would be wrapped and captured as an output of the model
+		static const char error[]="Unable to start the I/O committer thread\n";
+		__real_fwrite(error,sizeof(char),sizeof(error)-1,stderr);
+		abort();
+	}
+#endif
 }
 
-void reversibleio_collect(int lp,double event_horizon, msg_t* to_msg){
-	//we save the new event horizon for the current lp
-	per_lp_horizon[lp]=event_horizon;
-	//we start reading the event list to get the events inside the global window.
-	msg_t *msg=to_msg;
-	while(list_prev(msg)!=NULL){
-		msg=list_prev(msg);
+/** \brief Checks if the collection cursor of the given LP can be used.
+ * The message pointed by the cursor could have been pruned and reused for another event, in that case its epoch or frame will not match anymore.
+ * \param[in] lp_ptr The LP which owns the cursor.
+ * \returns 1 if the cursor can be used, 0 otherwise.
+ */
+static int collect_cursor_is_valid(LP_state* lp_ptr){
+	msg_t* cursor=lp_ptr->io_collect_cursor;
+	return cursor!=NULL && cursor->epoch==lp_ptr->io_collect_epoch && cursor->frame==lp_ptr->io_collect_frame;
+}
+
+/// \brief returns 1 if the first message comes after the second one in the LP timeline, 0 otherwise.
+static int msg_is_after(msg_t* first,msg_t* second){
+	return first->timestamp>second->timestamp || (first->timestamp==second->timestamp && first->tie_breaker>second->tie_breaker);
+}
+
+#if IO_ORDER_PER_FILE==1
+/** \brief Returns the merge heap of a file, creating it if needed.
+ * \param[in] file The file.
+ * \returns The merge heap, or NULL if the stream cannot be added to the registry or the heap cannot be allocated.
+ */
+static io_merger* stream_merger(FILE* file){
+	unsigned int i;
+	io_merger* merger;
+	iostream* stream=iostream_get(file);
+	if(stream!=NULL && stream->merger!=NULL){
+		return stream->merger;
 	}
-	while(msg!=NULL && msg->timestamp<event_horizon && to_msg!=msg){
-		///for the forward window we extract the I/O operations from the heap according to their timestamp and execute them
-		nblist_merge(&LPS[lp]->io_forward_window,&msg->io_forward_window);
-		nblist_destroy(&msg->io_forward_window,destroy_iobuffer);
+	stream=iostream_add(file);
+	if(stream==NULL){
+		return NULL;
+	}
+	while(!__sync_bool_compare_and_swap(&io_merger_lock,0,1));
+	if(stream->merger==NULL){
+		merger=rsalloc(sizeof(io_merger));
+		if(merger==NULL){
+			__sync_lock_release(&io_merger_lock);
+			return NULL;
+		}
+		merger->lists=rsalloc(sizeof(nblist)*n_prc_tot);
+		if(merger->lists==NULL){
+			rsfree(merger);
+			__sync_lock_release(&io_merger_lock);
+			return NULL;
+		}
+		merger->heap=io_heap_new(MIN_HEAP,n_prc_tot);
+		merger->draining=0;
+		for(i=0;i<n_prc_tot;i++){
+			nblist_init(&merger->lists[i]);
+			io_heap_add(merger->heap,&merger->lists[i]);
+		}
+		//the merge heap must be complete before it can be found by the committers
+		__sync_synchronize();
+		stream->merger=merger;
+	}
+	__sync_lock_release(&io_merger_lock);
+	return stream->merger;
+}
+
+#endif
+
+/** \brief Decides how the operations of an LP on a stream are collected.
+ * Only the streams declared with ::reversibleio_stream_private skip the heaps, a write by another LP makes the stream shared for good.
+ * \param[in] lp The LP.
+ * \param[in] file The stream.
+ * \returns COLLECT_ORDERED, COLLECT_UNORDERED or COLLECT_PRIVATE.
+ */
+static int collect_mode(int lp,FILE* file){
+	iostream* stream;
+	int owner;
+	if(!io_bypass){
+		return COLLECT_ORDERED;
+	}
+	stream=iostream_get(file);
+	if(stream==NULL){
+		return COLLECT_ORDERED;
+	}
+	if(stream->policy==IO_POLICY_UNORDERED){
+		return COLLECT_UNORDERED;
+	}
+	//the custom streams are written only by the committer
+	if(stream->flags&IOSTREAM_CUSTOM){
+		return COLLECT_ORDERED;
+	}
+	owner=stream->owner;
+	if(owner==lp){
+		return COLLECT_PRIVATE;
+	}
+	if(owner>=0){
+		//from now on the owner goes through the heaps as well
+		__sync_bool_compare_and_swap(&stream->owner,owner,IOSTREAM_OWNER_SHARED);
+	}
+	return COLLECT_ORDERED;
+}
+
+/** \brief Moves the operations of a committed window in the lists from where they will be executed.
+ * The writes on the ::IO_POLICY_UNORDERED streams and the operations on the streams private to the LP are executed right away by the calling thread.
+ * With ::IO_ORDER_PER_FILE the other operations go in the lists of the merge heaps of their files, the operations of the files which cannot get a merge heap go in the LP window, which is executed with the global heap.
+ * \param[in] lp The LP which owns the window.
+ * \param[in,out] window The window, it is left empty.
+ * \returns The number of bytes which have been executed right away.
+ */
+static unsigned long collect_window(int lp,nblist* window){
+	nblist_elem *elem=window->head,*next;
+	FILE* file=NULL;
+	nblist* list=NULL;
+	iobuffer* buf;
+	int mode=COLLECT_ORDERED;
+	unsigned long executed=0;
+#if IO_ORDER_PER_FILE==1
+	io_merger* merger;
+#endif
+	while(elem!=NULL){
+		next=elem->next;
+		if(elem->type==NBLIST_ELEM && elem->content!=NULL){
+			buf=(iobuffer*)elem->content;
+			//a window usually holds the operations of few files, so the last one is cached
+			if(file==NULL || buf->file!=file){
+				file=buf->file;
+				mode=collect_mode(lp,file);
+				list=NULL;
+			}
+			//an fclose or a positioned write on an unordered stream must wait for the operations of the other LPs, so they are always ordered
+			if(mode==COLLECT_PRIVATE || (mode==COLLECT_UNORDERED && buf->operation==IOBUF_FWRITE && buf->file_position<0)){
+				executed+=buf->buffer_elements_num*buf->buffer_elements_size;
+				if(buf->operation==IOBUF_FCLOSE){
+					//the FILE could be reused by a new stream in the next operations
+					file=NULL;
+				}
+				iowriter_unordered_write(buf);
+				rsfree(elem);
+			}else{
+				//the list is looked up only when needed, so the private streams never get a merge heap
+				if(list==NULL){
+#if IO_ORDER_PER_FILE==1
+					merger=stream_merger(file);
+					list=merger!=NULL ? &merger->lists[lp] : &LPS[lp]->io_forward_window;
+#else
+					list=&LPS[lp]->io_forward_window;
+#endif
+				}
+				nblist_append(list,elem);
+			}
+		}else{
+			rsfree(elem);
+		}
+		elem=next;
+	}
+	window->head=NULL;
+	window->tail=NULL;
+	window->old=NULL;
+	return executed;
+}
+
+/** \brief Releases the reverse window of a committed event, the pages of the mapped files it has saved can be written back.
+ * \param[in] msg The event.
+ */
+static void commit_window(msg_t* msg){
+	nblist_elem* elem;
+	for(elem=msg->io_reverse_window.head;elem!=NULL;elem=elem->next){
+		if(elem->type==NBLIST_ELEM && elem->content!=NULL && ((iobuffer*)elem->content)->operation==IOBUF_MMAP){
+			iomap_commit(elem->content);
+		}
+	}
+	nblist_destroy(&msg->io_reverse_window,destroy_iobuffer);
+}
+
+/** \brief Collects the I/O operations of the messages of the given LP which are older than the given horizon.
+ * \param[in] lp the lp id from where to collect messages
+ * \param[in] event_horizon The timestamp until events must be collected
+ * \param[in] to_msg The last message (included) which is being pruned from the LP queue, or NULL if no message is being pruned
+ */
+static void reversibleio_collect_until(int lp,double event_horizon, msg_t* to_msg){
+	LP_state* lp_ptr=LPS[lp];
+	msg_t *msg,*last=NULL;
+	unsigned long collected=0;
+	int advanced=0;
+	//we restart from the last collected message, so we read only the messages that became committable since the last collection
+	if(collect_cursor_is_valid(lp_ptr)){
+		last=lp_ptr->io_collect_cursor;
+		msg=list_next(last);
+	}else if(to_msg!=NULL){
+		//the messages that are being pruned are not reachable from the head of the queue anymore
+		msg=to_msg;
+		while(list_prev(msg)!=NULL){
+			msg=list_prev(msg);
+		}
+	}else{
+		msg=list_head(lp_ptr->queue_in);
+	}
+	while(msg!=NULL && msg->timestamp<event_horizon){
+		if(msg->io_forward_window.head!=NULL){
+			if(msg->io_forward_window.epoch==msg->epoch){
+				///for the forward window we move the I/O operations in the LP window, from where they will be extracted by the heap according to their timestamp
+				collected+=msg->io_forward_window.bytes;
+#if IO_ORDER_PER_FILE==1
+				collected-=collect_window(lp,&msg->io_forward_window);
+#else
+				if(io_bypass){
+					collected-=collect_window(lp,&msg->io_forward_window);
+				}else{
+					nblist_merge(&lp_ptr->io_forward_window,&msg->io_forward_window);
+				}
+#endif
+			}else{
+				///a window from an older epoch has been left by a rolled back execution which did not produce any I/O operation
+				nblist_destroy(&msg->io_forward_window,destroy_iobuffer);
+			}
+		}
 		///for the reverse window we destroy the nblist since we do not need to roll the I/O operations back
-		//nblist_destroy(LPS[lp]->io_reverse_window,destroy_iobuffer);
+		if(msg->io_reverse_window.head!=NULL){
+			commit_window(msg);
+		}
+		last=msg;
 		msg=list_next(msg);
+		advanced=1;
+	}
+	//if the last collected message is going to be pruned the next collection will start from the head of the queue
+	if(last!=NULL && (to_msg==NULL || msg_is_after(last,to_msg))){
+		lp_ptr->io_collect_cursor=last;
+		lp_ptr->io_collect_epoch=last->epoch;
+		lp_ptr->io_collect_frame=last->frame;
+	}else{
+		lp_ptr->io_collect_cursor=NULL;
+	}
+	if(collected>0){
+		__sync_fetch_and_add(&io_pending_bytes,collected);
+	}
+	//the positions and the metrics can be committed only by the events which have just been collected, so the critical section stays short when there are none
+	if(advanced && lp_ptr->io_positions!=NULL){
+		iopos_prune(lp,event_horizon);
+	}
+	if(advanced && lp_ptr->io_metrics!=NULL){
+		iometrics_commit(lp,event_horizon);
 	}
+	//we save the new event horizon for the current lp, the operations must be visible to the committer before the horizon
+	__sync_synchronize();
+	per_lp_horizon[lp]=event_horizon;
+}
+
+void reversibleio_collect(int lp){
+	//commit_horizon_ts and commit_horizon_tb are not updated atomically, so the events with the same timestamp of the horizon will be collected by the next call
+	reversibleio_collect_until(lp,LPS[lp]->commit_horizon_ts,NULL);
+}
+
+void reversibleio_detach(int lp,msg_t* to_msg){
+	reversibleio_collect_until(lp,LPS[lp]->commit_horizon_ts,to_msg);
+}
+
+int reversibleio_stream_policy(FILE* file,iostream_policy policy){
+	int flags;
+	iostream* stream;
+	if(policy==IO_POLICY_UNDO){
+		//the overwritten bytes are restored with pwrite, which appends on a file opened in append mode
+		flags=fcntl(fileno(file),F_GETFL);
+		if(__real_ftell(file)<0 || flags<0 || (flags&O_APPEND)){
+			return EINVAL;
+		}
+	}
+	if(policy==IO_POLICY_UNORDERED){
+		//the unordered records are written on the file descriptor, which a sink does not have
+		stream=iostream_get(file);
+		if(stream!=NULL && (stream->flags&IOSTREAM_SINK)){
+			return EINVAL;
+		}
+		io_bypass=1;
+	}
+	return iostream_set_policy(file,policy);
+}
+
+int reversibleio_stream_private(FILE* file){
+	io_bypass=1;
+	return iostream_set_owner(file,current_lp);
+}
+
+int reversibleio_stream_direct(FILE* file){
+	return iowriter_direct(file);
+}
+
+int reversibleio_stream_compress(FILE* file,int level){
+	return iowriter_compress(file,level);
+}
+
+int reversibleio_stream_segment(FILE* file,const char* prefix,double window){
+	return iowriter_segment(file,prefix,window);
+}
+
+int reversibleio_stream_index(FILE* file,const char* path,size_t every){
+	return iowriter_index(file,path,every);
+}
+
+FILE* reversibleio_sink_open(iosink* sink){
+	return iowriter_sink_open(sink);
+}
+
+int reversibleio_stream_columnar(FILE* file,size_t record_size,const iocolumn* columns,unsigned int n){
+	return iowriter_columnar(file,record_size,columns,n);
 }
 
 void reversibleio_rollback(msg_t *msg){
@@ -56,46 +464,269 @@ void reversibleio_rollback(msg_t *msg){
 	if(msg->io_forward_window.head!=NULL){
 		nblist_destroy(&msg->io_forward_window,destroy_iobuffer);
 	}
-	///For seekable files we need to restore them using the backups in the reverse window
+	///For seekable files the writes of an executed event have already been undone by ::reversibleio_undo, a message which is being removed has not been executed
+	if(msg->io_reverse_window.head!=NULL){
+		nblist_destroy(&msg->io_reverse_window,destroy_iobuffer);
+	}
 }
 
-void reversibleio_execute(){
-	//we need to compute the minimum event horizon
+/** \brief Undoes the writes executed by an event, from the newest to the oldest, and releases its reverse window.
+ * \param[in] msg The event.
+ */
+static void undo_window(msg_t* msg){
+	nblist_elem* elem;
+	iobuffer** undo;
+	unsigned int len=0,i=0;
+	for(elem=msg->io_reverse_window.head;elem!=NULL;elem=elem->next){
+		if(elem->type==NBLIST_ELEM && elem->content!=NULL){
+			len++;
+		}
+	}
+	if(len>0){
+		//the list can be walked only forward
+		undo=rsalloc(sizeof(iobuffer*)*len);
+		for(elem=msg->io_reverse_window.head;elem!=NULL;elem=elem->next){
+			if(elem->type==NBLIST_ELEM && elem->content!=NULL){
+				undo[i++]=elem->content;
+			}
+		}
+		while(i>0){
+			i--;
+			if(undo[i]->operation==IOBUF_MMAP){
+				iomap_undo(undo[i]);
+			}else if(undo[i]->operation==IOBUF_FOPEN){
+				//the file stays open, so the fopen executed again after the rollback gets it back
+				iopool_unref(undo[i]->file);
+			}else{
+				iobuffer_undo(undo[i]);
+			}
+		}
+		rsfree(undo);
+	}
+	nblist_destroy(&msg->io_reverse_window,destroy_iobuffer);
+}
+
+void reversibleio_undo(int lp,double destination_time,unsigned int tie_breaker){
+	msg_t* msg=LPS[lp]->bound;
+	if(LPS[lp]->io_positions!=NULL){
+		iopos_rollback(lp,destination_time,tie_breaker);
+	}
+	if(LPS[lp]->io_metrics!=NULL){
+		iometrics_rollback(lp,destination_time,tie_breaker);
+	}
+	//the events after the bound have not been executed, the ones before the destination will not be executed again
+	while(msg!=NULL && (msg->timestamp>destination_time || (msg->timestamp==destination_time && msg->tie_breaker>=tie_breaker))){
+		if(msg->io_reverse_window.head!=NULL){
+			undo_window(msg);
+		}
+		msg=list_prev(msg);
+	}
+}
+
+void reversibleio_replay(msg_t* msg){
+	iopos_replay(msg);
+}
+
+/** \brief Computes the global event horizon.
+ * \returns The minimum horizon among the LPs, no operation older than it can be collected anymore.
+ */
+static double reversibleio_horizon(){
 	unsigned int i;
-	double event_horizon;
-	event_horizon=-1;
+	double event_horizon=INFINITY;
 	for(i=0;i<n_prc_tot;i++){
-		if(per_lp_horizon[i]<event_horizon || event_horizon<0){
+		if(per_lp_horizon[i]<event_horizon){
 			event_horizon=per_lp_horizon[i];
 		}
 	}
-	double timestamp=0;
+	return event_horizon;
+}
+
+/** \brief Executes the collected operations which are older than the given horizon.
+ * The caller must own the commit role.
+ * \param[in] event_horizon The horizon until the operations can be executed.
+ * \param[in] quantum The maximum number of operations to execute.
+ * \returns The number of executed operations.
+ */
+static unsigned long reversibleio_drain(double event_horizon,unsigned long quantum){
+	unsigned long executed=0;
+	unsigned long written=0;
+	iobuffer* buf=NULL;
+	while(executed<quantum && (buf=(iobuffer*)io_heap_poll(io_h,event_horizon))!=NULL){
+		written+=buf->buffer_elements_num*buf->buffer_elements_size;
+		//the writer owns the buffer from now on
+		iowriter_write(buf);
+		executed++;
+	}
+	//everything older than the horizon has been written only if the quantum has not been reached
+	if(buf==NULL){
+		iowriter_horizon(event_horizon);
+	}
+	if(executed>0){
+		iowriter_end_batch();
+		__sync_fetch_and_sub(&io_pending_bytes,written);
+		reversibleio_clean();
+	}
+	return executed;
+}
+
+#if IO_ORDER_PER_FILE==1
+/** \brief Executes the collected operations of a file which are older than the given horizon.
+ * The caller must be the one which set the draining flag of the merge heap of the file.
+ * \param[in,out] stream The file.
+ * \param[in] event_horizon The horizon until the operations can be executed.
+ * \param[in] quantum The maximum number of operations to execute.
+ * \returns The number of executed operations.
+ */
+static unsigned long merger_drain(iostream* stream,double event_horizon,unsigned long quantum){
+	io_merger* merger=stream->merger;
+	iowriter_local local;
+	unsigned long executed=0;
+	unsigned long written=0;
+	unsigned int i;
 	iobuffer* buf=NULL;
-	while(timestamp<event_horizon){
-		buf=(iobuffer*)io_heap_poll(io_h);
-		if(buf!= NULL){
-			timestamp=buf->timestamp;
-			iobuffer_write(buf);
-		} else {
-			break;
+	local.file=NULL;
+	local.len=0;
+	local.positioned.file=NULL;
+	local.positioned.len=0;
+	while(executed<quantum && (buf=(iobuffer*)io_heap_poll(merger->heap,event_horizon))!=NULL){
+		written+=buf->buffer_elements_num*buf->buffer_elements_size;
+		iowriter_local_write(&local,stream,buf);
+		executed++;
+	}
+	iowriter_local_flush(&local);
+	if(buf==NULL){
+		iowriter_stream_horizon(stream,event_horizon);
+	}
+	if(executed>0){
+		__sync_fetch_and_sub(&io_pending_bytes,written);
+		for(i=0;i<n_prc_tot;i++){
+			nblist_clean(&merger->lists[i],destroy_iobuffer);
+		}
+	}
+	return executed;
+}
+
+/** \brief Executes the collected operations of every file whose merge heap is not being executed by another thread.
+ * \param[in] event_horizon The horizon until the operations can be executed.
+ * \param[in] quantum The maximum number of operations to execute for each file.
+ * \returns The number of executed operations.
+ */
+static unsigned long reversibleio_drain_files(double event_horizon,unsigned long quantum){
+	unsigned int i;
+	unsigned long executed=0;
+	iostream* stream;
+	io_merger* merger;
+	for(i=0;i<iostream_slots();i++){
+		stream=iostream_slot(i);
+		if(stream==NULL || (merger=stream->merger)==NULL){
+			continue;
 		}
+		if(merger->draining!=0 || !__sync_bool_compare_and_swap(&merger->draining,0,1)){
+			continue;
+		}
+		executed+=merger_drain(stream,event_horizon,quantum);
+		__sync_lock_release(&merger->draining);
 	}
+	return executed;
 }
 
-///To flush all the queues we insert a dummy node in each of the and we retry extracting
+/// \brief releases the merge heap of a file.
+static void merger_destroy(iostream* stream){
+	unsigned int i;
+	io_merger* merger=stream->merger;
+	if(merger==NULL){
+		return;
+	}
+	for(i=0;i<n_prc_tot;i++){
+		nblist_destroy(&merger->lists[i],destroy_iobuffer);
+	}
+	io_heap_delete(merger->heap);
+	rsfree(merger->lists);
+	rsfree(merger);
+	stream->merger=NULL;
+}
+#endif
+
+unsigned long reversibleio_try_execute(unsigned long quantum){
+	unsigned long executed=0;
+	unsigned long long start;
+	double event_horizon;
+	start=reversibleio_now();
+	event_horizon=reversibleio_horizon();
+#if IO_ORDER_PER_FILE==1
+	//the files are executed independently, so the threads can write different files at the same time
+	executed=reversibleio_drain_files(event_horizon,quantum);
+#endif
+	//someone else is already committing
+	if(io_commit_role!=0 || !__sync_bool_compare_and_swap(&io_commit_role,0,1)){
+		return executed;
+	}
+	executed+=reversibleio_drain(event_horizon,quantum);
+	//the deadline is always re-armed, otherwise every safe event would try again
+	if(executed>0){
+		reversibleio_tune(start,reversibleio_now());
+	}else{
+		reversibleio_backoff(reversibleio_now());
+	}
+	__sync_lock_release(&io_commit_role);
+	return executed;
+}
+
+unsigned long reversibleio_execute(){
+	return reversibleio_try_execute(ULONG_MAX);
+}
+
+int reversibleio_commit_due(){
+	unsigned long long now=reversibleio_now();
+	if(now<io_commit_retry){
+		return 0;
+	}
+	if(io_pending_bytes>=IO_COMMIT_BYTES){
+		return 1;
+	}
+	return now>=io_commit_deadline;
+}
+
+///At the end of the simulation nothing else will be collected, so all the collected operations can be executed.
 void reversibleio_flush(){
+#if IO_COMMITTER_THREAD==1
+	io_committer_stop=1;
+	pthread_join(io_committer,NULL);
+#endif
 	unsigned int i;
-	double max_timestamp=0,tmp;
+	//we wait for the current owner and never release the role, so no other thread will access io_h after the flush
+	while(!__sync_bool_compare_and_swap(&io_commit_role,0,1)){
+		sched_yield();
+	}
+	//the last committed events of each LP have not been collected yet
 	for(i=0;i<n_prc_tot;i++){
-		//we need to insert a dummy an element that is at least later than the current tail
-		tmp=LPS[i]->io_forward_window.tail->key;
-		if(tmp>max_timestamp){
-			max_timestamp=tmp+1;
+		while(!tryLock(i)){
+			sched_yield();
+		}
+		reversibleio_collect_until(i,nextafter(LPS[i]->commit_horizon_ts,INFINITY),NULL);
+		unlock(i);
+	}
+	//the records of the unordered streams which are left in their chunks
+	iowriter_unordered_flush();
+#if IO_ORDER_PER_FILE==1
+	iostream* stream;
+	for(i=0;i<iostream_slots();i++){
+		stream=iostream_slot(i);
+		if(stream==NULL || stream->merger==NULL){
+			continue;
+		}
+		//as for the role, the merge heap is never released
+		while(!__sync_bool_compare_and_swap(&stream->merger->draining,0,1)){
+			sched_yield();
 		}
-		nblist_add(&LPS[i]->io_forward_window,NULL,max_timestamp,NBLIST_DUMMY);
+		merger_drain(stream,INFINITY,ULONG_MAX);
 	}
-	//then we execute these events, so if the horizon is correct we will get the I/O operation executed
-	reversibleio_execute();
+#endif
+	reversibleio_drain(INFINITY,ULONG_MAX);
+	iowriter_flush();
+	iomap_sync();
+	//every update has been committed by the last collection
+	iometrics_emit();
 }
 
 void reversibleio_clean(){
@@ -111,6 +742,15 @@ void reversibleio_destroy(){
 	unsigned int i=0;
 	for(i=0;i<n_prc_tot;i++){
 		nblist_destroy(&LPS[i]->io_forward_window,destroy_iobuffer);
+		iopos_destroy(i);
+		iometrics_destroy(i);
 	}
 	io_heap_delete(io_h);
+#if IO_ORDER_PER_FILE==1
+	iostream_foreach(merger_destroy);
+#endif
+	rsfree(per_lp_horizon);
+	iowriter_destroy();
+	iomap_destroy();
+	iopool_destroy();
 }
@@ -5,26 +5,193 @@
 #define REVERSIBLEIO_H_INCLUDED
 
 #include <events.h>
+#include "iostream.h"
+#include "iomap.h"
+#include "iocolumnar.h"
+#include "iosink.h"
+
+#ifndef IO_COMMITTER_THREAD
+///If set to 1 a dedicated thread executes the collected operations, otherwise they are executed by the main worker thread.
+#define IO_COMMITTER_THREAD 0
+#endif
+
+#ifndef IO_COMMIT_STEALING
+///If set to 1 the worker threads which do not find any event to process execute the collected operations.
+#define IO_COMMIT_STEALING 0
+#endif
+
+#ifndef IO_COMMIT_QUANTUM
+///Maximum number of operations executed by an idle worker thread before going back to fetch events.
+#define IO_COMMIT_QUANTUM 64
+#endif
+
+#ifndef IO_COMMIT_BYTES
+///The collected operations are executed as soon as they hold at least this many bytes.
+#define IO_COMMIT_BYTES (1UL<<20)
+#endif
+
+#ifndef IO_COMMIT_LATENCY_MS
+///Maximum time (in ms) between two executions of the collected operations.
+#define IO_COMMIT_LATENCY_MS 100
+#endif
+
+#ifndef IO_COMMIT_MIN_MS
+///Minimum time (in ms) between two executions of the collected operations, unless ::IO_COMMIT_BYTES is reached.
+#define IO_COMMIT_MIN_MS 1
+#endif
+
+#ifndef IO_COMMIT_DUTY
+///Percentage of the wall clock time that should be spent executing the collected operations, used to adapt the interval between two executions.
+#define IO_COMMIT_DUTY 5
+#endif
 
 /** \brief Initializes the reversible io datastructures.
  * It initializes the non blocking queues in each LP and creates an heap to hold the forward windows of each Lp to create ordered I/O operations.
+ * If ::IO_COMMITTER_THREAD is set it also starts the committer thread, which will be the only one to access the heap until ::reversibleio_flush.
  */
 void reversibleio_init();
 
-/** \brief Collects the I/O operations from the events that are to be collected.
+/** \brief Collects the I/O operations of the committed events of the given LP.
+ * The events older than the commit horizon of the LP are collected, restarting from the last message collected on the LP, so only the messages that became committable since the previous call are read.
+ * The caller must hold the lock of the LP.
  * \param[in] lp the lp id from where to collect messages
- * \param[in] event_horizon The timestamp until events must be collected
- * \param[in] to_msg The message until the collection must be done
  */
-void reversibleio_collect(int lp,double event_horizon,msg_t* to_msg);
+void reversibleio_collect(int lp);
+
+/** \brief Collects the I/O operations of the messages which are being pruned from the LP queue.
+ * To be called by clean_checkpoint after the messages have been detached from the queue and before they are released.
+ * \param[in] lp the lp id from where the messages are being pruned
+ * \param[in] to_msg The last message (included) which is being pruned from the LP queue, or NULL if no message is being pruned
+ */
+void reversibleio_detach(int lp,msg_t* to_msg);
+
+/** \brief Sets how the writes on the given stream are handled.
+ * ::IO_POLICY_REVERSIBLE is the default, ::IO_POLICY_PASSTHROUGH writes immediately (e.g. for stderr) and ::IO_POLICY_DISCARD drops the writes.
+ * ::IO_POLICY_UNORDERED writes the committed output without ordering it, for streams such as debug logs which are sorted later: the collecting thread copies it in a chunk of the stream, which is written when it is full, at the fclose and at the end of the run.
+ * ::IO_POLICY_UNDO writes immediately and keeps the overwritten bytes to undo the write on rollback, so the output does not sit in memory until it is committed; it requires a seekable stream, not opened in append mode and written by a single LP.
+ * To be called by the model right after opening the stream, or during the initialization for the standard streams.
+ * \param[in] file The stream.
+ * \param[in] policy The policy.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_policy(FILE* file,iostream_policy policy);
+
+/** \brief Declares that the given stream is written only by the calling LP.
+ * Its committed operations are executed right away, in the LP order, by the thread which collects them, without going through the heaps.
+ * The declaration is trusted: if another LP writes on the stream anyway, the stream goes back to the heaps from then on, but the records of the owner which have already been written are not ordered with the ones of the other LP, so the output before that point can be out of timestamp order.
+ * To be called by the LP right after opening the stream, it has no effect on streams with custom settings (direct, compressed, segmented or indexed).
+ * \param[in] file The stream.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_private(FILE* file);
+
+/** \brief Writes the committed output of the given stream with O_DIRECT, so that it does not go through the page cache.
+ * To be called by the model right after opening the stream.
+ * \param[in] file The stream.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_direct(FILE* file);
+
+/** \brief Compresses the committed output of the given stream, each block of output is written as an independent gzip member.
+ * To be called by the model right after opening the stream, it requires ::IO_COMPRESSION.
+ * \param[in] file The stream.
+ * \param[in] level The zlib compression level (0-9).
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_compress(FILE* file,int level);
+
+/** \brief Splits the committed output of the given stream in segment files by simulated time window.
+ * Each segment is written as <prefix>.<k>.part and atomically renamed <prefix>.<k> once the global horizon passes the end of its window, so it can be processed while the simulation goes on.
+ * To be called by the model right after opening the stream.
+ * \param[in] file The stream.
+ * \param[in] prefix The path prefix of the segment files.
+ * \param[in] window The simulated time covered by each segment.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_segment(FILE* file,const char* prefix,double window);
+
+/** \brief Writes a sidecar index of the committed output of the given stream.
+ * The index is a binary file of {double timestamp; uint64_t offset} entries, one every `every` bytes of output, and it never points beyond the data written in the stream.
+ * To be called by the model right after opening the stream, it cannot be used with compressed or segmented streams.
+ * \param[in] file The stream.
+ * \param[in] path The path of the index file.
+ * \param[in] every The minimum distance (in bytes) between two entries.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_index(FILE* file,const char* path,size_t every);
+
+/** \brief Opens a stream whose committed output is handed to a sink instead of a file, e.g. a callback, a buffer in memory or a ring in shared memory tailed by a live consumer (see iosink.h).
+ * The model writes on the stream as on any other, with fwrite or fprintf, and closes it with fclose; the sink receives the committed records in timestamp order and it is closed with the stream.
+ * The stream cannot use the ::IO_POLICY_UNORDERED and ::IO_POLICY_UNDO policies.
+ * \param[in] sink The sink, created with one of the iosink_* functions.
+ * \returns The stream, or NULL with errno set on error.
+ */
+FILE* reversibleio_sink_open(iosink* sink);
+
+/** \brief Writes the committed output of the given stream, made of fixed size records, in columns.
+ * The records are transposed in batches, each column is encoded as requested (::IOCOLUMN_DELTA for timestamps, ::IOCOLUMN_DICT for small integers) and a footer describes the batches, see iocolumnar.h.
+ * To be called by the model right after opening the stream, the stream must receive only whole records of record_size bytes.
+ * \param[in] file The stream.
+ * \param[in] record_size The size of the records.
+ * \param[in] columns The columns of the records, e.g. `{offsetof(rec,ts),sizeof(double),IOCOLUMN_DELTA}`.
+ * \param[in] n The number of columns.
+ * \returns 0 on success, otherwise an error code.
+ */
+int reversibleio_stream_columnar(FILE* file,size_t record_size,const iocolumn* columns,unsigned int n);
+
+/** \brief Reserves space for a record of the given stream, so that the model can format or serialize it in place instead of passing it to fwrite, which copies it.
+ * The space is taken at the end of the record captured by the last reservation of the event on the same stream, if no other write has been captured since then, otherwise a new record is captured; reversibleio_commit extends the record without copying.
+ * Only one reservation per thread can be pending: a reservation which is not committed captures nothing, and its space is handed out again by the next one.
+ * E.g. `if((line=reversibleio_reserve(f,64))!=NULL){ reversibleio_commit(snprintf(line,64,"%f %d\n",now,me)); }` replaces the sprintf and the fwrite of a model, the commit truncates a line longer than the reservation.
+ * \param[in] file The stream.
+ * \param[in] len The size of the reserved space.
+ * \returns The reserved space, or NULL with errno set if it cannot be allocated.
+ */
+char* reversibleio_reserve(FILE* file,size_t len);
+
+/** \brief Captures the first len bytes of the space reserved by reversibleio_reserve, as fwrite would do.
+ * \param[in] len The size of the record, it is truncated to the reserved size.
+ * \returns The number of bytes captured, 0 with errno set on error (EINVAL if nothing has been reserved by the current event).
+ */
+size_t reversibleio_commit(size_t len);
 
 /** \brief rollbacks the I/O operations for the given message.
  * \param[in] msg The message to rollback;
  */
 void reversibleio_rollback(msg_t *msg);
 
-/// \brief Executes the collected operations
-void reversibleio_execute();
+/** \brief Undoes the writes on the ::IO_POLICY_UNDO streams and the mapped files executed by the events of an LP which are going to be rolled back, and the changes of its virtual positions.
+ * To be called by the rollback before the silent execution, with the LP lock held.
+ * \param[in] lp The LP.
+ * \param[in] destination_time The timestamp of the first event which will be executed again.
+ * \param[in] tie_breaker The tie breaker of the first event which will be executed again.
+ */
+void reversibleio_undo(int lp,double destination_time,unsigned int tie_breaker);
+
+/** \brief Tells the reversible I/O which event the silent execution is executing again, since the silent execution does not change current_msg.
+ * To be called by the silent execution before each event, and with NULL once it is over.
+ * \param[in] msg The event, or NULL.
+ */
+void reversibleio_replay(msg_t* msg);
+
+/** \brief Executes the collected operations which are older than the global event horizon.
+ * Nothing is done if another thread is already executing them.
+ * \returns The number of executed operations.
+ */
+unsigned long reversibleio_execute();
+
+/** \brief Checks if the collected operations should be executed.
+ * After an attempt which found nothing to execute the check backs off, so that the threads do not keep scanning the horizon.
+ * \returns 1 if at least ::IO_COMMIT_BYTES are waiting or if the deadline computed after the last execution has expired, 0 otherwise.
+ */
+int reversibleio_commit_due();
+
+/** \brief Executes at most quantum collected operations which are older than the global event horizon.
+ * It is meant to be called by idle worker threads, nothing is done if another thread is already executing the operations.
+ * \param[in] quantum The maximum number of operations to execute.
+ * \returns The number of executed operations.
+ */
+unsigned long reversibleio_try_execute(unsigned long quantum);
 
 /// \brief Frees the unnecessary memory.
 void reversibleio_clean();
@@ -32,6 +199,6 @@ void reversibleio_clean();
 ///\brief Destroys all the datastructures needed
 void reversibleio_destroy();
 
-///\brief Flushes the events in the queue according to the last event horizon.
+///\brief Flushes all the collected events, to be called once at the end of the simulation (it also stops the committer thread).
 void reversibleio_flush();
 #endif // REVERSIBLEIO_H_INCLUDED
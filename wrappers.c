@@ -4,9 +4,13 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
 #include <asm-generic/errno-base.h>
 #include <stdio.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <iobuffer.h>
 #include <wrappers.h>
 #include <queue.h>
@@ -15,6 +19,46 @@
 #include <core.h>
 #include <dymelor.h>
 #include <non_blocking_list.h>
+#include <iostream.h>
+#include <iopos.h>
+#include <iopool.h>
+
+///The last stream resolved by the thread, with its policy.
+static __thread FILE* cached_stream=NULL;
+static __thread iostream_policy cached_policy=IO_POLICY_REVERSIBLE;
+///The serial of the cached stream if it is positioned, 0 otherwise.
+static __thread unsigned int cached_serial=0;
+///The registry entry of the cached stream if it is an input stream, NULL otherwise.
+static __thread iostream* cached_input=NULL;
+///The registry generation of the cached policy.
+static __thread unsigned int cached_generation=0;
+
+/** \brief Resolves the policy of a stream, the last resolved stream is cached by each thread.
+ * \param[in] stream The stream.
+ * \returns The policy of the stream.
+ */
+static inline iostream_policy stream_policy(FILE* stream){
+	iostream* entry;
+	if(stream!=cached_stream || cached_generation!=iostream_generation){
+		cached_generation=iostream_generation;
+		entry=iostream_get(stream);
+		cached_policy=entry!=NULL ? entry->policy : IO_POLICY_REVERSIBLE;
+		//the undo streams use the real position of the FILE, the records of the streams with custom settings are transformed and appended
+		cached_serial=entry!=NULL && (entry->flags&IOSTREAM_POSITIONED) && !(entry->flags&IOSTREAM_CUSTOM) && entry->policy==IO_POLICY_REVERSIBLE ? entry->serial : 0;
+		cached_input=cached_serial!=0 && (entry->flags&IOSTREAM_INPUT) ? entry : NULL;
+		cached_stream=stream;
+	}
+	return cached_policy;
+}
+
+/** \brief Returns the serial of a stream if the LPs have a virtual position on it.
+ * \param[in] stream The stream.
+ * \returns The serial, or 0 if the stream uses the position of the FILE.
+ */
+static inline unsigned int stream_serial(FILE* stream){
+	stream_policy(stream);
+	return cached_serial;
+}
 
 /** \brief Initializes a window based on the message epoch.
  * \param[in] msg The message from which we get the epoch.
@@ -37,118 +81,360 @@ void init_window(msg_t* msg,nblist* list){
 }
 
 /** \brief small utility which helps to select the nblist according to the ftell result. Additionally it will init the list according to the epoch of the message.
+ * Until the reverse window can be used to restore seekable files, they are buffered in the forward window as well.
  * \param[in] msg event in which we must add the I/O operation.
  * \param[in] fpos return value from the ftell.
  * \param[in] err_code errno value after ftell.
  * \returns The list to be used to store the I/O operation
  */
-nblist* select_and_init_window(msg_t* msg,int fpos,int err_code){
+nblist* select_and_init_window(msg_t* msg,long fpos,int err_code){
 	nblist* list;
-	if(fpos<0 && err_code==ESPIPE){
-		list=&current_msg->io_forward_window;
-	}else{
-		list=&current_msg->io_reverse_window;
-	}
+	(void)fpos;
+	(void)err_code;
+	list=&msg->io_forward_window;
 	init_window(msg,list);
 	return list;
 }
 
+/** \brief Executes an fwrite immediately, saving the bytes it overwrites in the reverse window of the current event.
+ * The writes of a silent execution have already been executed, since the events before the rollback point are not undone, so they are skipped.
+ * \param[in] content The chars to be written.
+ * \param[in] size The size of each element.
+ * \param[in] nmemb The number of elements.
+ * \param[in] stream The file where the elements must be written.
+ * \returns nmemb on success, otherwise 0 and errno is set.
+ */
+static size_t undo_fwrite(const void* content, size_t size, size_t nmemb, FILE* stream){
+	struct stat st;
+	long fpos;
+	size_t old_len=0,res;
+	ssize_t done;
+	char* old=NULL;
+	iobuffer* undo;
+	if(LPS[current_lp]->state==LP_STATE_SILENT_EXEC){
+		return nmemb;
+	}
+	flockfile(stream);
+	//the position and the size of the file are consistent only once the FILE buffer has been written
+	fflush(stream);
+	fpos=__real_ftell(stream);
+	if(fpos<0 || fstat(fileno(stream),&st)!=0){
+		funlockfile(stream);
+		return 0;
+	}
+	if(fpos<st.st_size){
+		old_len=size*nmemb;
+		if(old_len>(size_t)(st.st_size-fpos)){
+			old_len=st.st_size-fpos;
+		}
+		old=rsalloc(old_len);
+		if(old==NULL){
+			funlockfile(stream);
+			errno=ENOMEM;
+			return 0;
+		}
+		done=pread(fileno(stream),old,old_len,fpos);
+		old_len=done>0 ? (size_t)done : 0;
+	}
+	undo=create_iobuffer(stream,old,sizeof(char),old_len,current_lvt,fpos,IOBUF_FWRITE);
+	if(undo==NULL){
+		rsfree(old);
+		funlockfile(stream);
+		errno=ENOMEM;
+		return 0;
+	}
+	undo->file_end=st.st_size;
+	init_window(current_msg,&current_msg->io_reverse_window);
+	if(nblist_add(&current_msg->io_reverse_window,undo,current_lvt,NBLIST_ELEM)!=NBLIST_OP_SUCCESS){
+		destroy_iobuffer(undo);
+		funlockfile(stream);
+		errno=ENOMEM;
+		return 0;
+	}
+	res=__real_fwrite(content,size,nmemb,stream);
+	funlockfile(stream);
+	return res;
+}
+
+/** \brief Stores an fwrite in the window of the current event.
+ * \param[in] content The chars to be written, from now on they are owned by the reversible I/O (they will be freed with the iobuffer).
+ * \param[in] size The size of each element.
+ * \param[in] nmemb The number of elements.
+ * \param[in] stream The file where the elements must be written.
+ * \param[in] policy The policy of the stream, ::IO_POLICY_REVERSIBLE, ::IO_POLICY_UNORDERED or ::IO_POLICY_UNDO.
+ * \returns nmemb on success, otherwise 0 and errno is set.
+ */
+static size_t capture_fwrite(void* content, size_t size, size_t nmemb, FILE* stream,iostream_policy policy){
+	int res;
+	long fpos=-1;
+	unsigned int serial;
+	size_t written;
+	iobuffer* buf;
+	nblist* list=NULL;
+	if(policy==IO_POLICY_UNDO){
+		written=undo_fwrite(content,size,nmemb,stream);
+		rsfree(content);
+		return written;
+	}
+	//the records of a positioned stream carry the virtual position of the LP, the other streams are written sequentially
+	serial=stream_serial(stream);
+	if(serial!=0){
+		fpos=iopos_get(current_lp,stream,serial);
+		if(iopos_set(current_lp,stream,serial,fpos+size*nmemb)!=0){
+			rsfree(content);
+			errno=ENOMEM;
+			return 0;
+		}
+	}
+	list=select_and_init_window(current_msg,fpos,0);
+	buf=create_iobuffer(stream,content,size,nmemb,current_lvt,fpos,IOBUF_FWRITE);
+	if(buf==NULL){
+		rsfree(content);
+		errno=ENOMEM;
+		return 0;
+	}
+	res=nblist_add(list,buf,current_lvt,NBLIST_ELEM);
+	if(res!=NBLIST_OP_SUCCESS){
+		destroy_iobuffer(buf);
+		errno=res;
+		return 0;
+	}
+	list->bytes+=size*nmemb;
+	return nmemb;
+}
 
 /** \brief wraps the fwrite, so the I/O operation will become reversible (so it also wraps the fprintf since gcc replaces it with the fwrite)
  * Takes all the parameters of the fwrite and has the same return values of the fwrite.
- * If the file pointer is seekable, the operation is stored in a buffer and delayed until the vent collection; otherwise the operation will be executed but a backup a the overwritten portion is taken so we can restore it in case of rollback.
+ * The content is copied and the operation is stored in a buffer and delayed until the event collection; for seekable files the operation should be executed taking a backup of the overwritten portion, so we could restore it in case of rollback.
  */
 size_t __wrap_fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream){
-	if(LPS[current_lp]->state==LP_STATE_ROLLBACK){
-		return size*nmemb;
+	iostream_policy policy=stream_policy(stream);
+	if(policy==IO_POLICY_PASSTHROUGH){
+		return __real_fwrite(ptr,size,nmemb,stream);
+	}
+	if(policy==IO_POLICY_DISCARD || LPS[current_lp]->state==LP_STATE_ROLLBACK){
+		return nmemb;
+	}
+	if(policy==IO_POLICY_UNDO){
+		return undo_fwrite(ptr,size,nmemb,stream);
 	}
-	int op_res,res;
-	int fpos=0;
 	void* tmp=NULL;
-	iobuffer* buf;
-	nblist* list=NULL;
-	//we check if the file is seekable
-	fpos=ftell(stream);
-	list=select_and_init_window(current_msg,fpos,errno);
-	if(fpos>=0){/*
-		///If ftell is successful then we take a backup (to be restored in case of rollback).
-		tmp=rsalloc(sizeof(size*nmemb));
-		memset(tmp,'\0',size*nmemb);
+	if(size*nmemb>0){
+		//the caller can reuse its buffer as soon as we return
+		tmp=rsalloc(size*nmemb);
 		if(tmp==NULL){
 			errno=ENOMEM;
 			return 0;
 		}
-		fread(tmp,size,nmemb,stream);
-		//we ignore the eof error
-		res=feof(stream);
-		if(res==0){
-			//but we can't ignore a generic error
-			res=ferror(stream);
-			if(res!=0){
-				errno=res;
-				return 0;
+		memcpy(tmp,ptr,size*nmemb);
+	}
+	return capture_fwrite(tmp,size,nmemb,stream,policy);
+}
+
+///The space reserved by the thread with reversibleio_reserve, which has not been committed yet.
+static __thread char* reserved=NULL;
+static __thread size_t reserved_len=0;
+static __thread FILE* reserved_stream=NULL;
+static __thread msg_t* reserved_msg=NULL;
+///The record captured by the last reservation, the next ones of the same event are served from its unused space.
+static __thread iobuffer* reserved_record=NULL;
+static __thread size_t reserved_capacity=0;
+static __thread unsigned int reserved_epoch=0;
+///The space of the reservations which are not captured (e.g. on a passthrough stream).
+static __thread char* scratch=NULL;
+static __thread size_t scratch_len=0;
+
+/** \brief Returns the record which the current reservation can be appended to.
+ * \param[in] list The forward window of the current event.
+ * \param[in] stream The stream of the reservation.
+ * \param[in] fpos The virtual position of the LP on the stream, -1 if it is not positioned.
+ * \returns The record, or NULL if the last record of the window is not the one of the last reservation.
+ */
+static iobuffer* reserved_tail(nblist* list,FILE* stream,long fpos){
+	iobuffer* buf;
+	if(reserved_record==NULL || reserved_msg!=current_msg || reserved_epoch!=current_msg->epoch || list->tail==NULL || list->tail->content!=reserved_record){
+		return NULL;
+	}
+	buf=reserved_record;
+	if(buf->file!=stream || (fpos>=0 && buf->file_position+(long)buf->buffer_elements_num!=fpos)){
+		return NULL;
+	}
+	return buf;
+}
+
+char* reversibleio_reserve(FILE* stream,size_t len){
+	iostream_policy policy=stream_policy(stream);
+	unsigned int serial;
+	long fpos=-1;
+	size_t capacity;
+	char* content;
+	nblist* list;
+	iobuffer* buf;
+	reserved=NULL;
+	reserved_len=len;
+	reserved_stream=stream;
+	if(policy==IO_POLICY_PASSTHROUGH || policy==IO_POLICY_DISCARD || policy==IO_POLICY_UNDO || LPS[current_lp]->state==LP_STATE_ROLLBACK){
+		//the record is written or dropped by the commit, so it is not captured
+		if(scratch_len<len || scratch==NULL){
+			content=rsrealloc(scratch,len>0 ? len : 1);
+			if(content==NULL){
+				errno=ENOMEM;
+				return NULL;
 			}
+			scratch=content;
+			scratch_len=len;
 		}
-		//we restore the original file position
-		res=fseek(stream,fpos,SEEK_SET);
-		if(res<0){
-			return 0;
+		reserved_msg=current_msg;
+		reserved_record=NULL;
+		reserved=scratch;
+		return reserved;
+	}
+	serial=stream_serial(stream);
+	if(serial!=0){
+		fpos=iopos_get(current_lp,stream,serial);
+	}
+	list=select_and_init_window(current_msg,fpos,0);
+	buf=reserved_tail(list,stream,fpos);
+	if(buf!=NULL && reserved_capacity-buf->buffer_elements_num<len){
+		//the record grows geometrically, what has been committed is moved with it
+		capacity=reserved_capacity*2;
+		if(capacity<buf->buffer_elements_num+len){
+			capacity=buf->buffer_elements_num+len;
 		}
-		//we do the fwrite
-		op_res=__real_fwrite(ptr,size,nmemb,stream);*/
-		//to temporarily avoid buffers creation for seekable files
-		fpos=-1;
-	}else{
-		//we create the iobuffer and add it to the list
-		tmp=ptr;
-		op_res=size*nmemb;
+		content=rsrealloc(buf->buffer,capacity);
+		if(content==NULL){
+			errno=ENOMEM;
+			return NULL;
+		}
+		buf->buffer=content;
+		reserved_capacity=capacity;
 	}
-	buf=create_iobuffer(stream,tmp,size,nmemb,current_lvt,fpos,IOBUF_FWRITE);
 	if(buf==NULL){
-		errno=ENOMEM;
-		return 0;
+		//a new record is captured at the end of the window
+		content=rsalloc(len>0 ? len : 1);
+		if(content==NULL){
+			errno=ENOMEM;
+			return NULL;
+		}
+		buf=create_iobuffer(stream,content,sizeof(char),0,current_lvt,fpos,IOBUF_FWRITE);
+		if(buf==NULL){
+			rsfree(content);
+			errno=ENOMEM;
+			return NULL;
+		}
+		if(nblist_add(list,buf,current_lvt,NBLIST_ELEM)!=NBLIST_OP_SUCCESS){
+			destroy_iobuffer(buf);
+			errno=ENOMEM;
+			return NULL;
+		}
+		reserved_record=buf;
+		reserved_capacity=len>0 ? len : 1;
+		reserved_msg=current_msg;
+		reserved_epoch=current_msg->epoch;
 	}
-	res=nblist_add(list,buf,current_lvt,NBLIST_ELEM);
-	if(res!=NBLIST_OP_SUCCESS){
-		errno=res;
+	reserved=(char*)buf->buffer+buf->buffer_elements_num;
+	return reserved;
+}
+
+size_t reversibleio_commit(size_t len){
+	unsigned int serial;
+	char* content=reserved;
+	iostream_policy policy;
+	nblist* list;
+	iobuffer* buf;
+	reserved=NULL;
+	if(content==NULL || reserved_msg!=current_msg){
+		errno=EINVAL;
 		return 0;
 	}
-	return op_res;
+	if(len>reserved_len){
+		len=reserved_len;
+	}
+	if(content==scratch){
+		policy=stream_policy(reserved_stream);
+		if(len==0 || policy==IO_POLICY_DISCARD || LPS[current_lp]->state==LP_STATE_ROLLBACK){
+			return len;
+		}
+		if(policy==IO_POLICY_PASSTHROUGH){
+			return __real_fwrite(content,sizeof(char),len,reserved_stream);
+		}
+		return undo_fwrite(content,sizeof(char),len,reserved_stream);
+	}
+	list=&current_msg->io_forward_window;
+	buf=reserved_record;
+	if(reserved_epoch!=current_msg->epoch || list->tail==NULL || list->tail->content!=buf){
+		//another write has been captured after the reservation, so the record is captured again after it
+		return __wrap_fwrite(content,sizeof(char),len,reserved_stream);
+	}
+	if(buf->file_position>=0){
+		serial=stream_serial(reserved_stream);
+		if(iopos_set(current_lp,reserved_stream,serial,buf->file_position+buf->buffer_elements_num+len)!=0){
+			errno=ENOMEM;
+			return 0;
+		}
+	}
+	//the reserved space is already in the record, which is extended without copying it
+	buf->buffer_elements_num+=len;
+	list->bytes+=len;
+	return len;
 }
 
 /** \brief This wrapper wraps the puts to out (and the printfs since gcc replaces them with puts) and redirects them to fwrite wrapper.
  * Behaves like the stdlib puts.
  */
 int __wrap_puts(const char *s){
-	int res;
-	//we get the number of chars that should be written
-	int size=snprintf(NULL,0,"%s\n",s)+1;
-	if(LPS[current_lp]->state==LP_STATE_ROLLBACK){
-		return size;
+	//we get the number of chars that should be written, the newline is added by puts
+	size_t len=strlen(s);
+	iostream_policy policy=stream_policy(stdout);
+	if(policy==IO_POLICY_PASSTHROUGH){
+		return __real_puts(s);
 	}
-	res=__wrap_fwrite(s,sizeof(char),size,stdout);
-	return res;
+	if(policy==IO_POLICY_DISCARD || LPS[current_lp]->state==LP_STATE_ROLLBACK){
+		return len+1;
+	}
+	char* string=rsalloc(sizeof(char)*(len+1));
+	if(string==NULL){
+		errno=ENOMEM;
+		return EOF;
+	}
+	memcpy(string,s,len);
+	string[len]='\n';
+	if(capture_fwrite(string,sizeof(char),len+1,stdout,policy)==0){
+		return EOF;
+	}
+	return len+1;
 }
 
 
 int __wrap_printf(const char * format, ...){
-	int res;
 	va_list args;
 	int len=0;
 	char* string=NULL;
+	iostream_policy policy=stream_policy(stdout);
 	va_start(args,format);
-	len=vsnprintf(NULL,0,format,args)+1;
+	if(policy==IO_POLICY_PASSTHROUGH){
+		len=vfprintf(stdout,format,args);
+		va_end(args);
+		return len;
+	}
+	len=vsnprintf(NULL,0,format,args);
 	va_end(args);
-	if(LPS[current_lp]->state==LP_STATE_ROLLBACK){
+	if(policy==IO_POLICY_DISCARD || LPS[current_lp]->state==LP_STATE_ROLLBACK || len<=0){
 		return len;
 	}
-	string=rsalloc(sizeof(char)*len);
-	memset(string,'\0',len);
+	//vsnprintf needs room for the terminator, which will not be written
+	string=rsalloc(sizeof(char)*(len+1));
+	if(string==NULL){
+		errno=ENOMEM;
+		return -1;
+	}
 	va_start(args,format);
-	vsnprintf(string,len,format,args);
+	vsnprintf(string,len+1,format,args);
 	va_end(args);
-	res=__wrap_fwrite(string,sizeof(char),len,stdout);
-	return res;
+	if(capture_fwrite(string,sizeof(char),len,stdout,policy)==0){
+		return -1;
+	}
+	return len;
 }
 
 /** We need to wrap the fclose since the model cannot close the file in an event that could be discarded.
@@ -156,20 +442,280 @@ int __wrap_printf(const char * format, ...){
  * Behaves like the fclose.
 */
 int __wrap_fclose(FILE* stream){
-	if(LPS[current_lp]->state==LP_STATE_ROLLBACK){
+	if(stream_policy(stream)==IO_POLICY_PASSTHROUGH){
+		if(!iopool_release(stream)){
+			return 0;
+		}
+		iostream_remove(stream);
+		return __real_fclose(stream);
+	}
+	//the fclose of the first execution is still in the window, another one would drop the reference of the file twice
+	if(LPS[current_lp]->state==LP_STATE_ROLLBACK || LPS[current_lp]->state==LP_STATE_SILENT_EXEC){
 		return 0;
 	}
 	init_window(current_msg,&current_msg->io_forward_window);
 	int res;
 	iobuffer* buf=create_iobuffer(stream,NULL,0,0,current_lvt,0,IOBUF_FCLOSE);
-	if(buf!=NULL){
+	if(buf==NULL){
 		errno=ENOMEM;
 		return EOF;
 	}
 	res=nblist_add(&current_msg->io_forward_window,buf,buf->timestamp,NBLIST_ELEM);
 	if(res!=NBLIST_OP_SUCCESS){
+		destroy_iobuffer(buf);
 		errno=res;
 		return EOF;
 	}
 	return 0;
 }
+
+/** \brief Wraps the fopen, so that the LPs get a virtual position on the regular files which are not opened in append mode.
+ * The file is opened immediately, the positions start from 0.
+ * A file opened only for reading is mapped in memory as well, so the reads of each LP follow its own position and are rolled back with it.
+ * Behaves like the fopen.
+ */
+FILE* __wrap_fopen(const char* path,const char* mode){
+	struct stat st;
+	int opened;
+	unsigned int serial;
+	iobuffer* undo;
+	//a silent execution gets back the file opened by the first execution, which still holds the reference
+	int silent=LPS[current_lp]->state==LP_STATE_SILENT_EXEC;
+	msg_t* event=iopos_event(current_lp);
+	FILE* stream=iopool_open(path,mode,current_lp,event->timestamp,event->tie_breaker,!silent,&opened);
+	if(stream==NULL){
+		return NULL;
+	}
+	//the LP starts from the beginning of the file, as with a new FILE
+	serial=!opened ? stream_serial(stream) : 0;
+	if(serial!=0 && iopos_set(current_lp,stream,serial,0)!=0){
+		if(!silent){
+			iopool_unref(stream);
+		}
+		errno=ENOMEM;
+		return NULL;
+	}
+	if(!silent){
+		undo=create_iobuffer(stream,NULL,0,0,current_lvt,-1,IOBUF_FOPEN);
+		init_window(current_msg,&current_msg->io_reverse_window);
+		if(undo==NULL || nblist_add(&current_msg->io_reverse_window,undo,current_lvt,NBLIST_ELEM)!=NBLIST_OP_SUCCESS){
+			destroy_iobuffer(undo);
+			iopool_unref(stream);
+			errno=ENOMEM;
+			return NULL;
+		}
+	}
+	if(!opened){
+		return stream;
+	}
+	if(strchr(mode,'a')!=NULL){
+		return stream;
+	}
+	//a stream which cannot be added to the registry keeps the position of the FILE
+	if(fstat(fileno(stream),&st)==0 && S_ISREG(st.st_mode) && iostream_set_positioned(stream)==0){
+		if(mode[0]=='r' && strchr(mode,'+')==NULL){
+			iostream_set_input(stream);
+		}
+	}
+	return stream;
+}
+
+/** \brief Returns the registry entry of a stream if it is an input stream.
+ * \param[in] stream The stream.
+ * \returns The entry, or NULL if the stream is read through the FILE.
+ */
+static inline iostream* stream_input(FILE* stream){
+	stream_policy(stream);
+	return cached_input;
+}
+
+/** \brief Moves the position of the current LP on an input stream, prefetching the next window of the file when a window boundary is crossed.
+ * \param[in] entry The input stream.
+ * \param[in] from The old position.
+ * \param[in] to The new position.
+ * \returns 0 on success, ENOMEM if the position cannot be recorded.
+ */
+static int input_advance(iostream* entry,long from,long to){
+	size_t window=(size_t)to/IO_INPUT_READAHEAD+1;
+	if(iopos_set(current_lp,entry->file,entry->serial,to)!=0){
+		return ENOMEM;
+	}
+	if((size_t)from/IO_INPUT_READAHEAD!=(size_t)to/IO_INPUT_READAHEAD && window*IO_INPUT_READAHEAD<entry->input_len){
+		//the window is page aligned as long as the readahead is a multiple of the page size
+		madvise((void*)(entry->input+window*IO_INPUT_READAHEAD),entry->input_len-window*IO_INPUT_READAHEAD<IO_INPUT_READAHEAD ? entry->input_len-window*IO_INPUT_READAHEAD : IO_INPUT_READAHEAD,MADV_WILLNEED);
+	}
+	return 0;
+}
+
+/** \brief Wraps the fread, on an input stream it copies from the mapping at the position of the current LP.
+ * Behaves like the fread.
+ */
+size_t __wrap_fread(void* ptr,size_t size,size_t nmemb,FILE* stream){
+	iostream* entry=stream_input(stream);
+	long pos;
+	size_t len;
+	if(entry==NULL){
+		return __real_fread(ptr,size,nmemb,stream);
+	}
+	if(size==0 || nmemb==0){
+		return 0;
+	}
+	pos=iopos_get(current_lp,stream,entry->serial);
+	if((size_t)pos>=entry->input_len){
+		return 0;
+	}
+	len=size*nmemb;
+	if(len>entry->input_len-pos){
+		len=entry->input_len-pos;
+	}
+	memcpy(ptr,entry->input+pos,len);
+	if(input_advance(entry,pos,pos+len)!=0){
+		errno=ENOMEM;
+		return 0;
+	}
+	//as the fread, a partial element is read but not counted
+	return len/size;
+}
+
+/** \brief Wraps the fgets, on an input stream it copies a line from the mapping at the position of the current LP.
+ * Behaves like the fgets.
+ */
+char* __wrap_fgets(char* s,int size,FILE* stream){
+	iostream* entry=stream_input(stream);
+	long pos;
+	size_t len;
+	const char* newline;
+	if(entry==NULL){
+		return __real_fgets(s,size,stream);
+	}
+	pos=iopos_get(current_lp,stream,entry->serial);
+	if(size<=0 || (size>1 && (size_t)pos>=entry->input_len)){
+		return NULL;
+	}
+	len=entry->input_len-pos;
+	if(len>(size_t)size-1){
+		len=size-1;
+	}
+	newline=memchr(entry->input+pos,'\n',len);
+	if(newline!=NULL){
+		len=newline-(entry->input+pos)+1;
+	}
+	memcpy(s,entry->input+pos,len);
+	s[len]='\0';
+	if(input_advance(entry,pos,pos+len)!=0){
+		errno=ENOMEM;
+		return NULL;
+	}
+	return s;
+}
+
+/** \brief Scans an input stream from the position of the current LP, through a memory stream on the mapping.
+ * \param[in] entry The input stream.
+ * \param[in] format The format.
+ * \param[in] args The arguments.
+ * \returns As the fscanf.
+ */
+static int input_scanf(iostream* entry,const char* format,va_list args){
+	FILE* mem;
+	long pos=iopos_get(current_lp,entry->file,entry->serial),consumed;
+	int res;
+	if((size_t)pos>=entry->input_len){
+		return EOF;
+	}
+	mem=fmemopen((void*)(entry->input+pos),entry->input_len-pos,"r");
+	if(mem==NULL){
+		return EOF;
+	}
+	res=vfscanf(mem,format,args);
+	//the characters pushed back by the scanf are not counted
+	consumed=__real_ftell(mem);
+	__real_fclose(mem);
+	if(consumed>0 && input_advance(entry,pos,pos+consumed)!=0){
+		errno=ENOMEM;
+		return EOF;
+	}
+	return res;
+}
+
+/** \brief Wraps the fscanf, on an input stream it scans the mapping from the position of the current LP.
+ * Behaves like the fscanf.
+ */
+int __wrap_fscanf(FILE* stream,const char* format,...){
+	va_list args;
+	int res;
+	iostream* entry=stream_input(stream);
+	va_start(args,format);
+	res=entry!=NULL ? input_scanf(entry,format,args) : vfscanf(stream,format,args);
+	va_end(args);
+	return res;
+}
+
+/** \brief Wraps the fscanf of C99, which replaces the fscanf when the model is compiled in C99 mode or later.
+ * Behaves like the fscanf.
+ */
+int __wrap___isoc99_fscanf(FILE* stream,const char* format,...){
+	va_list args;
+	int res;
+	iostream* entry=stream_input(stream);
+	va_start(args,format);
+	res=entry!=NULL ? input_scanf(entry,format,args) : vfscanf(stream,format,args);
+	va_end(args);
+	return res;
+}
+
+/** \brief Wraps the feof, on an input stream it checks the position of the current LP.
+ * Behaves like the feof.
+ */
+int __wrap_feof(FILE* stream){
+	iostream* entry=stream_input(stream);
+	if(entry==NULL){
+		return __real_feof(stream);
+	}
+	return (size_t)iopos_get(current_lp,stream,entry->serial)>=entry->input_len;
+}
+
+/** \brief Wraps the ftell, on a positioned stream it returns the virtual position of the current LP.
+ * Behaves like the ftell.
+ */
+long __wrap_ftell(FILE* stream){
+	unsigned int serial=stream_serial(stream);
+	if(serial==0){
+		return __real_ftell(stream);
+	}
+	return iopos_get(current_lp,stream,serial);
+}
+
+/** \brief Wraps the fseek, on a positioned stream it moves the virtual position of the current LP.
+ * SEEK_END is resolved against the size of the file, which includes only the committed writes.
+ * Behaves like the fseek.
+ */
+int __wrap_fseek(FILE* stream,long offset,int whence){
+	struct stat st;
+	long position;
+	unsigned int serial=stream_serial(stream);
+	if(serial==0){
+		return __real_fseek(stream,offset,whence);
+	}
+	if(LPS[current_lp]->state==LP_STATE_ROLLBACK){
+		return 0;
+	}
+	if(whence==SEEK_SET){
+		position=offset;
+	}else if(whence==SEEK_CUR){
+		position=iopos_get(current_lp,stream,serial)+offset;
+	}else if(whence==SEEK_END && fstat(fileno(stream),&st)==0){
+		position=st.st_size+offset;
+	}else{
+		errno=EINVAL;
+		return -1;
+	}
+	if(position<0){
+		errno=EINVAL;
+		return -1;
+	}
+	if(iopos_set(current_lp,stream,serial,position)!=0){
+		errno=ENOMEM;
+		return -1;
+	}
+	return 0;
+}
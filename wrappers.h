@@ -8,5 +8,11 @@ int __real_puts(const char* s);
 size_t __real_fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream);
 int __real_fclose(FILE* stream);
 int __real_printf(const char* format,...);
+FILE* __real_fopen(const char* path,const char* mode);
+long __real_ftell(FILE* stream);
+int __real_fseek(FILE* stream,long offset,int whence);
+size_t __real_fread(void* ptr,size_t size,size_t nmemb,FILE* stream);
+char* __real_fgets(char* s,int size,FILE* stream);
+int __real_feof(FILE* stream);
 
 #endif // WRAPPERS_H_INCLUDED